@@ -0,0 +1,134 @@
+#include "autotune_cache.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+std::filesystem::path EnvPath(const char* name) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return {};
+    }
+    return std::filesystem::path(value);
+}
+
+bool ParseU32(const std::string& text, std::uint32_t& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    try {
+        const unsigned long parsed = std::stoul(text);
+        if (parsed > 0xFFFFFFFFul) {
+            return false;
+        }
+        value = static_cast<std::uint32_t>(parsed);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// "<x>x<y>", as written by Save.
+bool ParseTileShape(const std::string& text, TileShape& shape) {
+    const std::size_t separator = text.find('x');
+    return separator != std::string::npos && ParseU32(text.substr(0, separator), shape.x) &&
+           ParseU32(text.substr(separator + 1), shape.y);
+}
+
+}  // namespace
+
+AutotuneCache AutotuneCache::Load(const std::filesystem::path& path) {
+    AutotuneCache cache;
+    cache.path_ = path;
+    std::ifstream in(path);
+    if (!in) {
+        return cache;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        Entry entry;
+        std::vector<std::string> fields;
+        std::istringstream fieldStream(line);
+        for (std::string field; std::getline(fieldStream, field, '\t');) {
+            fields.push_back(field);
+        }
+        const bool parsed = (fields.size() == 4 || fields.size() == 6) &&
+                            ParseU32(fields[2], entry.tuning.reduce.workgroupSize) &&
+                            ParseU32(fields[3], entry.tuning.reduce.maxGroups) &&
+                            (fields.size() == 4 || (ParseTileShape(fields[4], entry.tuning.stage.fused) &&
+                                                    ParseTileShape(fields[5], entry.tuning.stage.lab)));
+        if (!parsed) {
+            entry.raw = line;
+        } else {
+            entry.adapterKey = fields[0];
+            entry.reducePath = fields[1];
+        }
+        cache.entries_.push_back(std::move(entry));
+    }
+    return cache;
+}
+
+std::optional<AutotuneResult> AutotuneCache::Find(const std::string& adapterKey, const std::string& reducePath) const {
+    for (const Entry& entry : entries_) {
+        if (entry.raw.empty() && entry.adapterKey == adapterKey && entry.reducePath == reducePath) {
+            return entry.tuning;
+        }
+    }
+    return std::nullopt;
+}
+
+void AutotuneCache::Store(const std::string& adapterKey, const std::string& reducePath, const AutotuneResult& tuning) {
+    for (Entry& entry : entries_) {
+        if (entry.raw.empty() && entry.adapterKey == adapterKey && entry.reducePath == reducePath) {
+            entry.tuning = tuning;
+            return;
+        }
+    }
+    entries_.push_back({.adapterKey = adapterKey, .reducePath = reducePath, .tuning = tuning, .raw = {}});
+}
+
+void AutotuneCache::Save() const {
+    if (path_.has_parent_path()) {
+        std::filesystem::create_directories(path_.parent_path());
+    }
+    std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("failed to write autotune cache: " + path_.string());
+    }
+    for (const Entry& entry : entries_) {
+        if (!entry.raw.empty()) {
+            out << entry.raw << '\n';
+            continue;
+        }
+        const StageTuning& stage = entry.tuning.stage;
+        out << entry.adapterKey << '\t' << entry.reducePath << '\t' << entry.tuning.reduce.workgroupSize << '\t'
+            << entry.tuning.reduce.maxGroups << '\t' << stage.fused.x << 'x' << stage.fused.y << '\t' << stage.lab.x
+            << 'x' << stage.lab.y << '\n';
+    }
+    if (!out) {
+        throw std::runtime_error("failed to write autotune cache: " + path_.string());
+    }
+}
+
+std::filesystem::path DefaultAutotuneCachePath() {
+    std::filesystem::path base = EnvPath("XDG_CACHE_HOME");
+#if defined(_WIN32)
+    if (base.empty()) {
+        base = EnvPath("LOCALAPPDATA");
+    }
+#endif
+    if (base.empty()) {
+        const std::filesystem::path home = EnvPath("HOME");
+        if (home.empty()) {
+            return {};
+        }
+        base = home / ".cache";
+    }
+    return base / "dssim_gpu" / "autotune.tsv";
+}
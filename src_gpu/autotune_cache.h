@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Launch configuration of the ssim_reduce.wgsl passes: WG and MAX_GROUPS override values.
+struct ReduceTuning {
+    std::uint32_t workgroupSize = 256;
+    std::uint32_t maxGroups = 256;
+};
+
+// Workgroup tile of a per-level shader, as its x and y override values.
+struct TileShape {
+    std::uint32_t x = 0;
+    std::uint32_t y = 0;
+
+    bool operator==(const TileShape&) const = default;
+};
+
+// Tiles of the per-level stage0 shaders: the OUT_X/OUT_Y output tile of ssim_fused.wgsl,
+// and the TILE_X/TILE_Y tile shared by lab_preprocess.wgsl and stage0_absdiff.wgsl.
+struct StageTuning {
+    TileShape fused = {8, 8};
+    TileShape lab = {16, 16};
+};
+
+struct AutotuneResult {
+    ReduceTuning reduce;
+    StageTuning stage;
+};
+
+// --autotune results, one line per adapter and reduce path:
+//   <adapter key>\t<reduce path>\t<workgroup size>\t<max groups>\t<fused tile>\t<lab tile>
+// with tiles written as <x>x<y>. Lines without the two tiles (from before they were tuned)
+// load with the default StageTuning. Lines that do not parse are kept verbatim on Save so
+// that a newer tool's entries survive.
+class AutotuneCache {
+public:
+    // A missing file is an empty cache.
+    static AutotuneCache Load(const std::filesystem::path& path);
+
+    std::optional<AutotuneResult> Find(const std::string& adapterKey, const std::string& reducePath) const;
+    void Store(const std::string& adapterKey, const std::string& reducePath, const AutotuneResult& tuning);
+    // Creates the parent directory if needed.
+    void Save() const;
+
+    const std::filesystem::path& path() const { return path_; }
+
+private:
+    struct Entry {
+        std::string adapterKey;
+        std::string reducePath;
+        AutotuneResult tuning;
+        // Unparsed line, written back unchanged; empty for parsed entries.
+        std::string raw;
+    };
+
+    std::filesystem::path path_;
+    std::vector<Entry> entries_;
+};
+
+// $XDG_CACHE_HOME/dssim_gpu/autotune.tsv, else ~/.cache/dssim_gpu/autotune.tsv (or
+// %LOCALAPPDATA%\dssim_gpu on Windows); empty if none of those variables is set.
+std::filesystem::path DefaultAutotuneCachePath();
@@ -0,0 +1,547 @@
+#include "cpu_backend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "dssim_histogram.h"
+
+namespace {
+
+// Radius of the 5-tap Gaussian.
+constexpr std::uint32_t kPad = 2u;
+// Rows held by every ring buffer: one vertical 5-tap window.
+constexpr std::uint32_t kRingRows = 2u * kPad + 1u;
+// Fewest level-0 rows per strip; a strip converts up to 2 * kPad rows of every level above
+// and below its own.
+constexpr std::uint32_t kMinStripRows = 64u;
+
+struct LevelSize {
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+};
+
+// Rows [begin, end) of one level.
+struct RowRange {
+    std::uint32_t begin = 0;
+    std::uint32_t end = 0;
+
+    bool Contains(std::uint32_t y) const { return y >= begin && y < end; }
+    bool Empty() const { return begin >= end; }
+};
+
+// The rows of one level a strip deals with: the dssim rows it scores (owned), the final
+// Lab rows those read (lab), the pixel rows converted to Lab for them (labInput), and every
+// pixel row it receives (pixels), which adds the rows the next level's pixels average.
+struct LevelWindow {
+    RowRange owned;
+    RowRange lab;
+    RowRange labInput;
+    RowRange pixels;
+};
+
+// One pixel row of one image: level 0 rows point into the decoder's RGBA8, later levels are
+// RGBA f32 averages of sRGB-encoded values, as downsample_pyramid.wgsl stores them.
+struct PixelRow {
+    const std::uint8_t* bytes = nullptr;
+    const float* pixels = nullptr;
+};
+
+struct StreamParams {
+    const CpuKernels& kernels;
+    const std::array<float, 256>& lut;
+    std::uint32_t qscale;
+};
+
+// Where one level of a strip writes its results; rows outside the strip's owned range are
+// never touched, so strips share these.
+struct LevelSink {
+    // One per pool thread: every finished dssim row is added to
+    // histograms[ThreadPool::CurrentSlot()], and the caller merges them afterwards.
+    DssimHistogram* histograms = nullptr;
+    // Second pass only (DssimHistogram::Resolves), likewise one per pool thread.
+    DssimBucketSplit* splits = nullptr;
+    // The whole map; debug dumps only.
+    std::uint32_t* dssimQ = nullptr;
+    // Channel-0 moments (CpuLevelOutputs::mu1 and on); level 0 of a debug dump only.
+    CpuLevelOutputs* moments = nullptr;
+    // The level's own pixels; level 1 of a debug dump only.
+    std::array<float*, 2> pixels = {};
+};
+
+std::uint32_t ClampRow(std::int64_t y, std::uint32_t height) {
+    return static_cast<std::uint32_t>(std::clamp<std::int64_t>(y, 0, static_cast<std::int64_t>(height) - 1));
+}
+
+// range widened by `by` rows on either side, clipped to [0, height).
+RowRange Widen(const RowRange& range, std::uint32_t by, std::uint32_t height) {
+    return {.begin = range.begin - std::min(range.begin, by), .end = std::min(height, range.end + by)};
+}
+
+// Copies row src of width n into dst with kPad clamped pixels on either side.
+void PadRow(const float* src, std::uint32_t n, float* dst) {
+    dst[0] = src[0];
+    dst[1] = src[0];
+    std::copy(src, src + n, dst + kPad);
+    dst[n + kPad] = src[n - 1];
+    dst[n + kPad + 1] = src[n - 1];
+}
+
+// srgb_to_linear in dssim_common.wgsl.
+float SrgbToLinear(float c) {
+    if (c <= 0.04045f) {
+        return c / 12.92f;
+    }
+    return std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float UnpackUnorm8(std::uint8_t value) {
+    return static_cast<float>(value) / 255.0f;
+}
+
+float LoadChannel(const PixelRow& row, std::size_t i) {
+    return row.bytes != nullptr ? UnpackUnorm8(row.bytes[i]) : row.pixels[i];
+}
+
+// One row of the next pyramid level (downsample_pyramid.wgsl): `width` pixels, each the
+// quad average of its 2x2 block in rows top and bottom.
+void DownsampleRow(const PixelRow& top, const PixelRow& bottom, std::uint32_t width, float* dst) {
+    for (std::uint32_t x = 0; x < width; ++x) {
+        for (std::uint32_t c = 0; c < 4u; ++c) {
+            const std::size_t left = static_cast<std::size_t>(2u * x) * 4u + c;
+            const std::size_t right = left + 4u;
+            const float tl = LoadChannel(top, left);
+            const float tr = LoadChannel(top, right);
+            const float bl = LoadChannel(bottom, left);
+            const float br = LoadChannel(bottom, right);
+            dst[x * 4u + c] = (tl + tr + bl + br) * 0.25f;
+        }
+    }
+}
+
+// Level windows of the strip of level-0 rows [begin, end). Strip edges other than the
+// bottom of the image are multiples of 2^(levels - 1), so the level-k rows
+// [begin >> k, end >> k) of consecutive strips tile every level.
+std::vector<LevelWindow> StripWindows(const std::vector<LevelSize>& sizes, std::uint32_t begin, std::uint32_t end) {
+    std::vector<LevelWindow> windows(sizes.size());
+    for (std::size_t k = sizes.size(); k-- > 0;) {
+        const std::uint32_t height = sizes[k].height;
+        LevelWindow& window = windows[k];
+        window.owned.begin = std::min(height, begin >> k);
+        window.owned.end = (end == sizes[0].height) ? height : std::min(height, end >> k);
+        if (!window.owned.Empty()) {
+            window.lab = Widen(window.owned, kPad, height);
+            window.labInput = Widen(window.owned, 2u * kPad, height);
+            window.pixels = window.labInput;
+        }
+        if (k + 1 < sizes.size() && !windows[k + 1].pixels.Empty()) {
+            const RowRange below = {.begin = 2u * windows[k + 1].pixels.begin, .end = 2u * windows[k + 1].pixels.end};
+            window.pixels = window.pixels.Empty()
+                                ? below
+                                : RowRange{.begin = std::min(window.pixels.begin, below.begin),
+                                           .end = std::max(window.pixels.end, below.end)};
+        }
+    }
+    return windows;
+}
+
+// One level of one strip as a stream. Pixel rows of both images come in top to bottom
+// through PushRow, and each stage runs as soon as its 5-row window is complete, keeping a
+// ring of kRingRows rows:
+//   pixel row -> Lab, a and b blurred horizontally (lab_preprocess.wgsl convert + blur)
+//             -> final Lab row: a and b blurred vertically
+//             -> horizontal moments of all three channels (stage0_absdiff.wgsl)
+//             -> vertical moments and the dssim row, added to the level's histogram.
+// Every odd pixel row is averaged with the one above into a row of the next level, which is
+// pushed on at once, so one sweep over level 0 runs the whole pyramid. The working set is a
+// few dozen rows of each level, whatever the image height.
+class LevelStream {
+public:
+    LevelStream(const StreamParams& params, LevelSize size, const LevelWindow& window, LevelStream* next,
+                const LevelSink& sink)
+        : params_(params),
+          size_(size),
+          window_(window),
+          next_(next),
+          sink_(sink),
+          nextLab_(window.lab.begin),
+          nextDssim_(window.owned.begin) {
+        const std::size_t w = size.width;
+        labRing_.resize(2u * 3u * kRingRows * w);
+        momentRing_.resize(3u * 5u * kRingRows * w);
+        pixelSlots_.resize(2u * 2u * 4u * w);
+        rgb_.resize(3u * w);
+        rawAb_.resize(2u * w);
+        finalLab_.resize(2u * 3u * w);
+        padded_.resize(2u * (w + 2u * kPad));
+        vertical_.resize(5u * w);
+        acc_.resize(6u * w);
+        dssimRow_.resize(w);
+    }
+
+    LevelStream(const LevelStream&) = delete;
+    LevelStream& operator=(const LevelStream&) = delete;
+
+    // Row y of both images; rows arrive in order over window().pixels.
+    void PushRow(std::uint32_t y, const std::array<PixelRow, 2>& rows) {
+        const std::size_t w = size_.width;
+        if (window_.owned.Contains(y)) {
+            for (std::size_t i = 0; i < 2u; ++i) {
+                if (sink_.pixels[i] != nullptr) {
+                    std::copy_n(rows[i].pixels, 4u * w, sink_.pixels[i] + static_cast<std::size_t>(y) * 4u * w);
+                }
+            }
+        }
+        if (window_.labInput.Contains(y)) {
+            for (std::size_t i = 0; i < 2u; ++i) {
+                ConvertRow(i, y, rows[i]);
+            }
+            labInputEnd_ = y + 1u;
+            FinishLabRows();
+        }
+        if (next_ == nullptr) {
+            return;
+        }
+        if (y % 2u == 0u) {
+            previous_ = rows;
+        } else if (next_->window_.pixels.Contains(y / 2u)) {
+            const std::uint32_t ny = y / 2u;
+            std::array<PixelRow, 2> nextRows;
+            for (std::size_t i = 0; i < 2u; ++i) {
+                float* slot = next_->PixelSlot(i, ny);
+                DownsampleRow(previous_[i], rows[i], next_->size_.width, slot);
+                nextRows[i] = PixelRow{.bytes = nullptr, .pixels = slot};
+            }
+            next_->PushRow(ny, nextRows);
+        }
+    }
+
+private:
+    // Ring rows: raw L (channel 0) or horizontally blurred a / b (channels 1, 2) of image i.
+    float* LabRing(std::size_t i, std::size_t channel, std::uint32_t y) {
+        return labRing_.data() + ((i * 3u + channel) * kRingRows + y % kRingRows) * size_.width;
+    }
+
+    // Ring rows: horizontal moment m (s1, s2, q1, q2, p12) of one channel.
+    float* MomentRing(std::size_t channel, std::size_t m, std::uint32_t y) {
+        return momentRing_.data() + ((channel * 5u + m) * kRingRows + y % kRingRows) * size_.width;
+    }
+
+    // Storage for pixel row y of image i, filled by the previous level. Two rows per image:
+    // the odd row is averaged while the even one above it is still held.
+    float* PixelSlot(std::size_t i, std::uint32_t y) {
+        return pixelSlots_.data() + (i * 2u + y % 2u) * 4u * size_.width;
+    }
+
+    // lab_from_rgbaplu of pixel row y, then the horizontal half of the a/b blur.
+    void ConvertRow(std::size_t i, std::uint32_t y, const PixelRow& row) {
+        const std::uint32_t width = size_.width;
+        float* r = rgb_.data();
+        float* g = r + width;
+        float* b = g + width;
+        for (std::uint32_t x = 0; x < width; ++x) {
+            const std::size_t p = static_cast<std::size_t>(x) * 4u;
+            float pr;
+            float pg;
+            float pb;
+            float a;
+            if (row.bytes != nullptr) {
+                pr = params_.lut[row.bytes[p]];
+                pg = params_.lut[row.bytes[p + 1u]];
+                pb = params_.lut[row.bytes[p + 2u]];
+                a = UnpackUnorm8(row.bytes[p + 3u]);
+            } else {
+                pr = SrgbToLinear(row.pixels[p]);
+                pg = SrgbToLinear(row.pixels[p + 1u]);
+                pb = SrgbToLinear(row.pixels[p + 2u]);
+                a = row.pixels[p + 3u];
+            }
+            pr = pr * a;
+            pg = pg * a;
+            pb = pb * a;
+            // lab_from_rgbaplu's dither; its `a < 255` test always holds for unorm alpha.
+            const std::uint32_t n = (x + 11u) ^ (y + 11u);
+            const float oneMinusA = 1.0f - a;
+            if ((n & 16u) != 0u) {
+                pr = pr + oneMinusA;
+            }
+            if ((n & 8u) != 0u) {
+                pg = pg + oneMinusA;
+            }
+            if ((n & 32u) != 0u) {
+                pb = pb + oneMinusA;
+            }
+            r[x] = pr;
+            g[x] = pg;
+            b[x] = pb;
+        }
+        float* rawA = rawAb_.data();
+        float* rawB = rawA + width;
+        params_.kernels.labRow(r, g, b, width, LabRing(i, 0, y), rawA, rawB);
+        PadRow(rawA, width, padded_.data());
+        params_.kernels.blurRow(padded_.data(), width, LabRing(i, 1, y));
+        PadRow(rawB, width, padded_.data());
+        params_.kernels.blurRow(padded_.data(), width, LabRing(i, 2, y));
+    }
+
+    // Final Lab rows whose vertical window of converted rows is complete, and their
+    // horizontal moments.
+    void FinishLabRows() {
+        const std::uint32_t width = size_.width;
+        const std::uint32_t last = size_.height - 1u;
+        const std::size_t w = width;
+        while (nextLab_ < window_.lab.end && std::min(nextLab_ + kPad, last) < labInputEnd_) {
+            const std::uint32_t y = nextLab_;
+            const float* lab[2][3];
+            for (std::size_t i = 0; i < 2u; ++i) {
+                lab[i][0] = LabRing(i, 0, y);
+                for (std::size_t c = 1; c < 3u; ++c) {
+                    const float* taps[kRingRows];
+                    for (std::uint32_t k = 0; k < kRingRows; ++k) {
+                        taps[k] = LabRing(i, c, ClampRow(static_cast<std::int64_t>(y) + k - kPad, size_.height));
+                    }
+                    float* out = finalLab_.data() + (i * 3u + c) * w;
+                    params_.kernels.verticalRow(taps, width, out);
+                    lab[i][c] = out;
+                }
+            }
+            float* padded1 = padded_.data();
+            float* padded2 = padded1 + w + 2u * kPad;
+            for (std::size_t c = 0; c < 3u; ++c) {
+                PadRow(lab[0][c], width, padded1);
+                PadRow(lab[1][c], width, padded2);
+                params_.kernels.momentsRow(padded1, padded2, width, MomentRing(c, 0, y), MomentRing(c, 1, y),
+                                           MomentRing(c, 2, y), MomentRing(c, 3, y), MomentRing(c, 4, y));
+            }
+            ++nextLab_;
+            FinishDssimRows();
+        }
+    }
+
+    // Owned dssim rows whose vertical window of moment rows is complete.
+    void FinishDssimRows() {
+        const std::uint32_t width = size_.width;
+        const std::uint32_t last = size_.height - 1u;
+        const std::size_t w = width;
+        while (nextDssim_ < window_.owned.end && std::min(nextDssim_ + kPad, last) < nextLab_) {
+            const std::uint32_t y = nextDssim_;
+            float* const accRows[6] = {acc_.data(),          acc_.data() + w,      acc_.data() + 2u * w,
+                                       acc_.data() + 3u * w, acc_.data() + 4u * w, acc_.data() + 5u * w};
+            for (std::size_t c = 0; c < 3u; ++c) {
+                for (std::size_t m = 0; m < 5u; ++m) {
+                    const float* taps[kRingRows];
+                    for (std::uint32_t k = 0; k < kRingRows; ++k) {
+                        taps[k] = MomentRing(c, m, ClampRow(static_cast<std::int64_t>(y) + k - kPad, size_.height));
+                    }
+                    params_.kernels.verticalRow(taps, width, vertical_.data() + m * w);
+                }
+                params_.kernels.accumulateRow(vertical_.data(), vertical_.data() + w, vertical_.data() + 2u * w,
+                                              vertical_.data() + 3u * w, vertical_.data() + 4u * w, width, c == 0,
+                                              accRows);
+                if (c == 0 && sink_.moments != nullptr) {
+                    const std::size_t row = static_cast<std::size_t>(y) * w;
+                    std::copy_n(vertical_.data(), w, sink_.moments->mu1.data() + row);
+                    std::copy_n(vertical_.data() + w, w, sink_.moments->mu2.data() + row);
+                    std::copy_n(accRows[3], w, sink_.moments->var1.data() + row);
+                    std::copy_n(accRows[4], w, sink_.moments->var2.data() + row);
+                    std::copy_n(accRows[5], w, sink_.moments->cov12.data() + row);
+                }
+            }
+            std::uint32_t* out = (sink_.dssimQ != nullptr) ? sink_.dssimQ + static_cast<std::size_t>(y) * w
+                                                            : dssimRow_.data();
+            params_.kernels.dssimRow(accRows, width, params_.qscale, out);
+            if (sink_.histograms != nullptr) {
+                sink_.histograms[ThreadPool::CurrentSlot()].AddRow(out, w);
+            }
+            if (sink_.splits != nullptr) {
+                sink_.splits[ThreadPool::CurrentSlot()].AddRow(out, w);
+            }
+            ++nextDssim_;
+        }
+    }
+
+    const StreamParams& params_;
+    const LevelSize size_;
+    const LevelWindow window_;
+    LevelStream* const next_;
+    const LevelSink sink_;
+
+    std::vector<float> labRing_;
+    std::vector<float> momentRing_;
+    std::vector<float> pixelSlots_;
+    std::vector<float> rgb_;
+    std::vector<float> rawAb_;
+    std::vector<float> finalLab_;
+    std::vector<float> padded_;
+    std::vector<float> vertical_;
+    std::vector<float> acc_;
+    std::vector<std::uint32_t> dssimRow_;
+
+    std::array<PixelRow, 2> previous_ = {};
+    // Converted rows end here; the ring holds the last kRingRows of them.
+    std::uint32_t labInputEnd_ = 0;
+    std::uint32_t nextLab_;
+    std::uint32_t nextDssim_;
+};
+
+// Streams both images through every level, one strip of level-0 rows per work item. Strip
+// edges are multiples of 2^(levels - 1) rows so that they stay on row boundaries of every
+// level.
+void StreamStrips(
+    const StreamParams& params,
+    const std::vector<LevelSize>& sizes,
+    const DecodedImage& image1,
+    const DecodedImage& image2,
+    const std::vector<LevelSink>& sinks,
+    ThreadPool& pool) {
+    const std::size_t levels = sizes.size();
+    const std::uint32_t align = 1u << (levels - 1u);
+    const std::uint32_t height = sizes[0].height;
+    std::uint32_t stripRows = RowBandHeight(height, pool.threadCount(), std::max(kMinStripRows, align));
+    stripRows = (stripRows + align - 1u) / align * align;
+    ParallelRowBands(pool, height, stripRows, 0, [&](const RowBand& band) {
+        const std::vector<LevelWindow> windows = StripWindows(sizes, band.begin, band.end);
+        std::vector<std::unique_ptr<LevelStream>> streams(levels);
+        for (std::size_t k = levels; k-- > 0;) {
+            if (!windows[k].pixels.Empty()) {
+                LevelStream* next = (k + 1 < levels) ? streams[k + 1].get() : nullptr;
+                streams[k] = std::make_unique<LevelStream>(params, sizes[k], windows[k], next, sinks[k]);
+            }
+        }
+        const std::size_t rowBytes = static_cast<std::size_t>(sizes[0].width) * 4u;
+        for (std::uint32_t y = windows[0].pixels.begin; y < windows[0].pixels.end; ++y) {
+            streams[0]->PushRow(y, {PixelRow{.bytes = image1.pixels.data() + y * rowBytes, .pixels = nullptr},
+                                    PixelRow{.bytes = image2.pixels.data() + y * rowBytes, .pixels = nullptr}});
+        }
+    });
+}
+
+}  // namespace
+
+CpuCompareOutputs CpuCompare(
+    const CpuKernels& kernels,
+    const DecodedImage& image1,
+    const DecodedImage& image2,
+    const CpuCompareOptions& options,
+    ThreadPool& pool) {
+    if (image1.width != image2.width || image1.height != image2.height) {
+        throw std::runtime_error("image size mismatch; multi-scale stage requires identical dimensions");
+    }
+    const std::size_t expectedBytes = static_cast<std::size_t>(image1.width) * image1.height * 4u;
+    if (image1.pixels.size() != expectedBytes || image2.pixels.size() != expectedBytes) {
+        throw std::runtime_error("cpu backend expects RGBA8 pixels");
+    }
+    if (options.levelCount == 0) {
+        throw std::runtime_error("cpu backend needs at least one level");
+    }
+    std::vector<LevelSize> sizes = {LevelSize{.width = image1.width, .height = image1.height}};
+    for (std::uint32_t scaleLevel = 1; scaleLevel < options.levelCount; ++scaleLevel) {
+        sizes.push_back(LevelSize{.width = sizes.back().width / 2u, .height = sizes.back().height / 2u});
+    }
+    for (std::uint32_t scaleLevel = 0; scaleLevel < options.levelCount; ++scaleLevel) {
+        if (sizes[scaleLevel].width == 0 || sizes[scaleLevel].height == 0) {
+            throw std::runtime_error("cpu backend level " + std::to_string(scaleLevel) + " is empty");
+        }
+    }
+    const std::array<float, 256> lut = BuildSrgbToLinearLut();
+    const StreamParams params = {.kernels = kernels, .lut = lut, .qscale = options.qscale};
+
+    CpuCompareOutputs outputs;
+    outputs.levels.resize(options.levelCount);
+    const unsigned threads = pool.threadCount();
+    std::vector<DssimHistogram> histograms(static_cast<std::size_t>(options.levelCount) * threads);
+    std::vector<LevelSink> sinks(options.levelCount);
+    for (std::uint32_t scaleLevel = 0; scaleLevel < options.levelCount; ++scaleLevel) {
+        CpuLevelOutputs& level = outputs.levels[scaleLevel];
+        level.width = sizes[scaleLevel].width;
+        level.height = sizes[scaleLevel].height;
+        const std::size_t len = static_cast<std::size_t>(level.width) * level.height;
+        LevelSink& sink = sinks[scaleLevel];
+        sink.histograms = &histograms[static_cast<std::size_t>(scaleLevel) * threads];
+        if (options.debugDump && scaleLevel <= 1) {
+            level.dssimQ.resize(len);
+            sink.dssimQ = level.dssimQ.data();
+        }
+        if (options.debugDump && scaleLevel == 0) {
+            for (std::vector<float>* plane : {&level.mu1, &level.mu2, &level.var1, &level.var2, &level.cov12}) {
+                plane->resize(len);
+            }
+            sink.moments = &level;
+        }
+        if (options.debugDump && scaleLevel == 1) {
+            for (std::size_t i = 0; i < 2u; ++i) {
+                outputs.firstDownsample[i].resize(len * 4u);
+                sink.pixels[i] = outputs.firstDownsample[i].data();
+            }
+        }
+    }
+    StreamStrips(params, sizes, image1, image2, sinks, pool);
+
+    // Levels whose threshold lands inside a non-empty coarse bucket are streamed again, down
+    // to the deepest of them, counting only that bucket's values above the threshold.
+    std::vector<std::uint64_t> hiCounts(options.levelCount);
+    std::vector<std::vector<DssimBucketSplit>> splits(options.levelCount);
+    std::size_t splitLevels = 0;
+    for (std::uint32_t scaleLevel = 0; scaleLevel < options.levelCount; ++scaleLevel) {
+        CpuLevelOutputs& level = outputs.levels[scaleLevel];
+        DssimHistogram& histogram = histograms[static_cast<std::size_t>(scaleLevel) * threads];
+        for (unsigned slot = 1; slot < threads; ++slot) {
+            histogram.Merge(histograms[static_cast<std::size_t>(scaleLevel) * threads + slot]);
+        }
+        level.stats.sum = histogram.sum();
+        level.stats.threshold =
+            DssimDeviationThreshold(level.stats.sum, histogram.count(), options.qscale, scaleLevel);
+        histogram.Partition(level.stats.threshold, hiCounts[scaleLevel], level.stats.hiSum);
+        if (!histogram.Resolves(level.stats.threshold)) {
+            splits[scaleLevel].assign(threads, DssimBucketSplit(level.stats.threshold));
+            splitLevels = scaleLevel + 1u;
+        }
+    }
+    if (splitLevels > 0) {
+        std::vector<LevelSink> splitSinks(splitLevels);
+        for (std::size_t scaleLevel = 0; scaleLevel < splitLevels; ++scaleLevel) {
+            if (!splits[scaleLevel].empty()) {
+                splitSinks[scaleLevel].splits = splits[scaleLevel].data();
+            }
+        }
+        const std::vector<LevelSize> splitSizes(sizes.begin(), sizes.begin() + splitLevels);
+        StreamStrips(params, splitSizes, image1, image2, splitSinks, pool);
+    }
+    for (std::uint32_t scaleLevel = 0; scaleLevel < options.levelCount; ++scaleLevel) {
+        CpuLevelStats& stats = outputs.levels[scaleLevel].stats;
+        if (!splits[scaleLevel].empty()) {
+            DssimBucketSplit& split = splits[scaleLevel].front();
+            for (unsigned slot = 1; slot < threads; ++slot) {
+                split.Merge(splits[scaleLevel][slot]);
+            }
+            hiCounts[scaleLevel] += split.hiCount();
+            stats.hiSum += split.hiSum();
+        }
+        stats.hiCount = static_cast<std::uint32_t>(hiCounts[scaleLevel]);
+    }
+    return outputs;
+}
+
+double DssimDeviationCenter(std::uint64_t sum, std::size_t len, std::uint32_t qscale, std::uint32_t scaleLevel) {
+    const double q = static_cast<double>(qscale);
+    const double meanDssim = static_cast<double>(sum) / (static_cast<double>(len) * q);
+    const double meanSsim = 1.0 - 2.0 * meanDssim;
+    const double avg = std::pow(std::max(meanSsim, 0.0), std::pow(0.5, static_cast<double>(scaleLevel)));
+    return (1.0 - avg) * q * 0.5;
+}
+
+std::uint32_t DssimDeviationThreshold(std::uint64_t sum, std::size_t len, std::uint32_t qscale, std::uint32_t scaleLevel) {
+    // t lies in [0, qscale / 2].
+    return static_cast<std::uint32_t>(std::floor(DssimDeviationCenter(sum, len, qscale, scaleLevel)));
+}
+
+std::array<float, 256> BuildSrgbToLinearLut() {
+    std::array<float, 256> lut = {};
+    for (std::size_t i = 0; i < lut.size(); ++i) {
+        const float s = static_cast<float>(i) / 255.0f;
+        lut[i] = (s <= 0.04045f) ? s / 12.92f : std::pow((s + 0.055f) / 1.055f, 2.4f);
+    }
+    return lut;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_kernels.h"
+#include "png_loader.h"
+#include "thread_pool.h"
+
+// CPU engine behind --backend cpu. It runs the same per-level pipeline as the GPU path
+// (downsample_pyramid.wgsl, lab_preprocess.wgsl / ssim_fused.wgsl, stage0_absdiff.wgsl and
+// ssim_reduce.wgsl) with the row kernels of cpu_kernels.h, and reports each level as the
+// integers the GPU reduction produces, so the host scores both backends the same way.
+//
+// Unlike the GPU path it never holds full-frame Lab, blurred or moment planes: rows are
+// streamed through every stage with 5-row ring buffers, and the next pyramid level is
+// averaged from them on the way, so the working set per level grows with the image width
+// only. The image is cut into horizontal strips that stream independently on a ThreadPool.
+// Finished dssim rows go into a DssimHistogram per level rather than a stored map.
+
+// Host mirror of LevelStats in ssim_reduce.wgsl; threshold is DssimDeviationThreshold.
+struct CpuLevelStats {
+    std::uint64_t sum = 0;
+    std::uint32_t threshold = 0;
+    std::uint32_t hiCount = 0;
+    std::uint64_t hiSum = 0;
+};
+
+struct CpuLevelOutputs {
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    CpuLevelStats stats;
+    // Quantized dssim map; only kept for levels 0 and 1 of a debug dump.
+    std::vector<std::uint32_t> dssimQ;
+    // First Lab channel of the blurred moments (as main_debug in stage0_absdiff.wgsl);
+    // level 0 of a debug dump only.
+    std::vector<float> mu1;
+    std::vector<float> mu2;
+    std::vector<float> var1;
+    std::vector<float> var2;
+    std::vector<float> cov12;
+};
+
+struct CpuCompareOptions {
+    // Level 0 plus levelCount - 1 pyramid levels.
+    std::uint32_t levelCount = 1;
+    std::uint32_t qscale = 0;
+    // Keep the maps, moments and level-1 pixels listed in CpuLevelOutputs / CpuCompareOutputs.
+    bool debugDump = false;
+};
+
+struct CpuCompareOutputs {
+    std::vector<CpuLevelOutputs> levels;
+    // Level 1 of each image as RGBA f32 (sRGB-encoded, as the GPU pyramid holds it); only
+    // kept for a debug dump.
+    std::array<std::vector<float>, 2> firstDownsample;
+};
+
+// Scores image1 against image2 (same dimensions, RGBA8) with `kernels`, each pass split into
+// row bands on `pool`.
+CpuCompareOutputs CpuCompare(
+    const CpuKernels& kernels,
+    const DecodedImage& image1,
+    const DecodedImage& image2,
+    const CpuCompareOptions& options,
+    ThreadPool& pool);
+
+// Centre t = (1 - avg) * qscale / 2 of a level's absolute deviations, in double, with avg =
+// pow(max(mean_ssim, 0), 0.5^scaleLevel) from the sum of its len quantized dssim values.
+// Splitting the map at floor(t) makes the host's mean absolute deviation exact, so both
+// backends partition there (DssimDeviationThreshold).
+double DssimDeviationCenter(std::uint64_t sum, std::size_t len, std::uint32_t qscale, std::uint32_t scaleLevel);
+std::uint32_t DssimDeviationThreshold(std::uint64_t sum, std::size_t len, std::uint32_t qscale, std::uint32_t scaleLevel);
+
+// dssim-core's gamma table for 8-bit channels: to_linear(i / 255) evaluated in f32. The GPU
+// path uploads it for the packed RGBA8 entry points; the CPU engine decodes level 0 with it.
+std::array<float, 256> BuildSrgbToLinearLut();
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Row kernels of the CPU backend (cpu_backend.cpp). One table per instruction set; all of
+// them run the same f32 operations in the same order as the WGSL shaders, so every table
+// produces bit-identical results and the CPU scores track the GPU ones.
+struct CpuKernels {
+    const char* isa;
+
+    // lab_from_rgbaplu after dithering: premultiplied linear r, g, b -> L, a, b planes.
+    void (*labRow)(const float* r, const float* g, const float* b, std::size_t n, float* outL, float* outA,
+                   float* outB);
+    // 5-tap Gaussian of src, which holds n + 4 values (2 clamped pixels on either side).
+    void (*blurRow)(const float* src, std::size_t n, float* dst);
+    // Horizontal 5-tap sums of v1, v2, v1^2, v2^2 and v1*v2; v1 and v2 are padded as in blurRow.
+    void (*momentsRow)(const float* v1, const float* v2, std::size_t n, float* s1, float* s2, float* q1,
+                       float* q2, float* p12);
+    // 5-tap Gaussian over rows[0..4] (top to bottom).
+    void (*verticalRow)(const float* const* rows, std::size_t n, float* dst);
+    // Adds one channel's blurred moments (mu1, mu2, sumsq1, sumsq2, sum12) into the six
+    // dssim_q_from accumulators; first starts them. acc: mu1^2, mu2^2, mu1*mu2, var1,
+    // var2, cov12.
+    void (*accumulateRow)(const float* mu1, const float* mu2, const float* sumsq1, const float* sumsq2,
+                          const float* sum12, std::size_t n, bool first, float* const* acc);
+    // dssim_q_from over the accumulated channels.
+    void (*dssimRow)(const float* const* acc, std::size_t n, std::uint32_t qscale, std::uint32_t* out);
+};
+
+enum class CpuIsa {
+    // Widest instruction set the CPU and OS support.
+    Auto,
+    Avx512,
+    Avx2,
+    Scalar,
+};
+
+const CpuKernels& ScalarCpuKernels();
+// Only callable when CpuSupportsAvx2() / CpuSupportsAvx512() say so; x86 builds only
+// (DSSIM_X86_KERNELS).
+const CpuKernels& Avx2CpuKernels();
+const CpuKernels& Avx512CpuKernels();
+
+bool CpuSupportsAvx2();
+bool CpuSupportsAvx512();
+
+// Kernels for isa; throws if an explicitly requested instruction set is unavailable.
+const CpuKernels& SelectCpuKernels(CpuIsa isa);
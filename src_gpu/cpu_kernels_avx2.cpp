@@ -0,0 +1,35 @@
+// Built with -mavx2 (/arch:AVX2); only entered after CpuSupportsAvx2().
+#include <immintrin.h>
+
+#include "cpu_kernels_impl.h"
+
+namespace {
+
+struct Avx2Vec {
+    using T = __m256;
+    using Mask = __m256;
+    static constexpr std::size_t kWidth = 8;
+
+    static T Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, T v) { _mm256_storeu_ps(p, v); }
+    static T Set(float v) { return _mm256_set1_ps(v); }
+    static T Add(T a, T b) { return _mm256_add_ps(a, b); }
+    static T Sub(T a, T b) { return _mm256_sub_ps(a, b); }
+    static T Mul(T a, T b) { return _mm256_mul_ps(a, b); }
+    static T Div(T a, T b) { return _mm256_div_ps(a, b); }
+    static T Min(T a, T b) { return _mm256_min_ps(a, b); }
+    static T Max(T a, T b) { return _mm256_max_ps(a, b); }
+    static Mask Gt(T a, T b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static T Select(Mask m, T ifTrue, T ifFalse) { return _mm256_blendv_ps(ifFalse, ifTrue, m); }
+    // Values are in [0, 2^31), so the signed conversion is exact; it rounds half to even.
+    static void StoreRoundedU32(std::uint32_t* p, T v) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm256_cvtps_epi32(v));
+    }
+};
+
+}  // namespace
+
+const CpuKernels& Avx2CpuKernels() {
+    static const CpuKernels kernels = cpu_kernels::MakeCpuKernels<Avx2Vec>("avx2");
+    return kernels;
+}
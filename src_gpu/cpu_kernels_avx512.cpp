@@ -0,0 +1,40 @@
+// Built with -mavx512f (/arch:AVX512); only entered after CpuSupportsAvx512().
+#include <immintrin.h>
+
+#include "cpu_kernels_impl.h"
+
+namespace {
+
+struct Avx512Vec {
+    using T = __m512;
+    using Mask = __mmask16;
+    static constexpr std::size_t kWidth = 16;
+    static constexpr Mask kAllLanes = 0xFFFF;
+
+    static T Load(const float* p) { return _mm512_loadu_ps(p); }
+    static void Store(float* p, T v) { _mm512_storeu_ps(p, v); }
+    static T Set(float v) { return _mm512_set1_ps(v); }
+    static T Add(T a, T b) { return _mm512_add_ps(a, b); }
+    static T Sub(T a, T b) { return _mm512_sub_ps(a, b); }
+    static T Mul(T a, T b) { return _mm512_mul_ps(a, b); }
+    static T Div(T a, T b) { return _mm512_div_ps(a, b); }
+    // The zero-masked forms with every lane set compute the same thing. The unmasked ones
+    // pass _mm512_undefined_ps() as the merge source, which g++ 12 reports under
+    // -Wmaybe-uninitialized.
+    static T Min(T a, T b) { return _mm512_maskz_min_ps(kAllLanes, a, b); }
+    static T Max(T a, T b) { return _mm512_maskz_max_ps(kAllLanes, a, b); }
+    static Mask Gt(T a, T b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static T Select(Mask m, T ifTrue, T ifFalse) { return _mm512_mask_blend_ps(m, ifFalse, ifTrue); }
+    // Values are in [0, 2^31), so the signed conversion is exact; it rounds half to even.
+    // Zero-masked for the same reason as Min and Max.
+    static void StoreRoundedU32(std::uint32_t* p, T v) {
+        _mm512_storeu_si512(p, _mm512_maskz_cvtps_epi32(kAllLanes, v));
+    }
+};
+
+}  // namespace
+
+const CpuKernels& Avx512CpuKernels() {
+    static const CpuKernels kernels = cpu_kernels::MakeCpuKernels<Avx512Vec>("avx512");
+    return kernels;
+}
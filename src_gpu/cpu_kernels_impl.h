@@ -0,0 +1,225 @@
+#pragma once
+
+// Kernel bodies shared by cpu_kernels_scalar.cpp, cpu_kernels_avx2.cpp and
+// cpu_kernels_avx512.cpp. Each of those defines a vector type V with
+//   T, Mask, kWidth, Load, Store, Set, Add, Sub, Mul, Div, Min, Max, Gt, Select, StoreRoundedU32
+// and instantiates MakeCpuKernels<V>. Tails shorter than V::kWidth run through ScalarVec, so
+// every element sees the same operations whatever the width. Only separate multiplies and
+// adds are used (no FMA), and the kernel sources are built with contraction disabled.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "cpu_kernels.h"
+
+namespace cpu_kernels {
+
+struct ScalarVec {
+    using T = float;
+    using Mask = bool;
+    static constexpr std::size_t kWidth = 1;
+
+    static T Load(const float* p) { return *p; }
+    static void Store(float* p, T v) { *p = v; }
+    static T Set(float v) { return v; }
+    static T Add(T a, T b) { return a + b; }
+    static T Sub(T a, T b) { return a - b; }
+    static T Mul(T a, T b) { return a * b; }
+    static T Div(T a, T b) { return a / b; }
+    static T Min(T a, T b) { return std::min(a, b); }
+    static T Max(T a, T b) { return std::max(a, b); }
+    static Mask Gt(T a, T b) { return a > b; }
+    static T Select(Mask m, T ifTrue, T ifFalse) { return m ? ifTrue : ifFalse; }
+    // Round half to even, as WGSL round() and the default MXCSR rounding.
+    static void StoreRoundedU32(std::uint32_t* p, T v) { *p = static_cast<std::uint32_t>(std::nearbyint(v)); }
+};
+
+// Constants exactly as the WGSL compiler materialises them: abstract-float expressions are
+// folded in double and converted once; `let` values are f32 from the start.
+constexpr float kGauss[5] = {0.095332f, 0.236190f, 0.336957f, 0.236190f, 0.095332f};
+constexpr float kD65X = 0.9505f;
+constexpr float kD65Y = 1.0f;
+constexpr float kD65Z = 1.089f;
+constexpr float kEpsilon = static_cast<float>(216.0 / 24389.0);
+constexpr float kK = static_cast<float>(24389.0 / (27.0 * 116.0));
+constexpr float kOffset16 = static_cast<float>(16.0 / 116.0);
+constexpr float kA1 = static_cast<float>(500.0 / 220.0);
+constexpr float kA2 = static_cast<float>(86.2 / 220.0);
+constexpr float kB1 = static_cast<float>(200.0 / 220.0);
+constexpr float kB2 = static_cast<float>(107.9 / 220.0);
+constexpr float kC1 = static_cast<float>(0.01 * 0.01);
+constexpr float kC2 = static_cast<float>(0.03 * 0.03);
+
+template <class V>
+typename V::T CbrtPoly(typename V::T x) {
+    using T = typename V::T;
+    const T two = V::Set(2.0f);
+    T y = V::Add(V::Mul(V::Add(V::Mul(V::Set(-0.5f), x), V::Set(1.51f)), x), V::Set(0.2f));
+    T y3 = V::Mul(V::Mul(y, y), y);
+    y = V::Div(V::Mul(y, V::Add(y3, V::Mul(two, x))), V::Add(V::Mul(two, y3), x));
+    y3 = V::Mul(V::Mul(y, y), y);
+    y = V::Div(V::Mul(y, V::Add(y3, V::Mul(two, x))), V::Add(V::Mul(two, y3), x));
+    return y;
+}
+
+template <class V>
+typename V::T LabAxis(typename V::T f) {
+    const typename V::T cube = V::Sub(CbrtPoly<V>(f), V::Set(kOffset16));
+    return V::Select(V::Gt(f, V::Set(kEpsilon)), cube, V::Mul(V::Set(kK), f));
+}
+
+template <class V>
+void LabAt(const float* r, const float* g, const float* b, std::size_t i, float* outL, float* outA, float* outB) {
+    using T = typename V::T;
+    const T rv = V::Load(r + i);
+    const T gv = V::Load(g + i);
+    const T bv = V::Load(b + i);
+    const auto dot = [&](float cr, float cg, float cb, float d) {
+        const T t = V::Add(V::Mul(rv, V::Set(cr / d)), V::Mul(gv, V::Set(cg / d)));
+        return V::Add(t, V::Mul(bv, V::Set(cb / d)));
+    };
+    const T fx = dot(0.4124f, 0.3576f, 0.1805f, kD65X);
+    const T fy = dot(0.2126f, 0.7152f, 0.0722f, kD65Y);
+    const T fz = dot(0.0193f, 0.1192f, 0.9505f, kD65Z);
+    const T x = LabAxis<V>(fx);
+    const T y = LabAxis<V>(fy);
+    const T z = LabAxis<V>(fz);
+    V::Store(outL + i, V::Mul(y, V::Set(1.05f)));
+    V::Store(outA + i, V::Add(V::Mul(V::Set(kA1), V::Sub(x, y)), V::Set(kA2)));
+    V::Store(outB + i, V::Add(V::Mul(V::Set(kB1), V::Sub(y, z)), V::Set(kB2)));
+}
+
+template <class V>
+void BlurAt(const float* src, std::size_t i, float* dst) {
+    typename V::T acc = V::Set(0.0f);
+    for (std::size_t k = 0; k < 5; ++k) {
+        acc = V::Add(acc, V::Mul(V::Set(kGauss[k]), V::Load(src + i + k)));
+    }
+    V::Store(dst + i, acc);
+}
+
+template <class V>
+void MomentsAt(const float* v1, const float* v2, std::size_t i, float* s1, float* s2, float* q1, float* q2,
+               float* p12) {
+    using T = typename V::T;
+    T a1 = V::Set(0.0f);
+    T a2 = V::Set(0.0f);
+    T aq1 = V::Set(0.0f);
+    T aq2 = V::Set(0.0f);
+    T ap = V::Set(0.0f);
+    for (std::size_t k = 0; k < 5; ++k) {
+        const T w = V::Set(kGauss[k]);
+        const T x1 = V::Load(v1 + i + k);
+        const T x2 = V::Load(v2 + i + k);
+        const T w1 = V::Mul(w, x1);
+        a1 = V::Add(a1, w1);
+        a2 = V::Add(a2, V::Mul(w, x2));
+        aq1 = V::Add(aq1, V::Mul(w1, x1));
+        aq2 = V::Add(aq2, V::Mul(V::Mul(w, x2), x2));
+        ap = V::Add(ap, V::Mul(w1, x2));
+    }
+    V::Store(s1 + i, a1);
+    V::Store(s2 + i, a2);
+    V::Store(q1 + i, aq1);
+    V::Store(q2 + i, aq2);
+    V::Store(p12 + i, ap);
+}
+
+template <class V>
+void VerticalAt(const float* const* rows, std::size_t i, float* dst) {
+    typename V::T acc = V::Set(0.0f);
+    for (std::size_t k = 0; k < 5; ++k) {
+        acc = V::Add(acc, V::Mul(V::Set(kGauss[k]), V::Load(rows[k] + i)));
+    }
+    V::Store(dst + i, acc);
+}
+
+template <class V>
+void AccumulateAt(const float* mu1, const float* mu2, const float* sumsq1, const float* sumsq2,
+                  const float* sum12, std::size_t i, bool first, float* const* acc) {
+    using T = typename V::T;
+    const T m1 = V::Load(mu1 + i);
+    const T m2 = V::Load(mu2 + i);
+    const T zero = V::Set(0.0f);
+    const T terms[6] = {
+        V::Mul(m1, m1),
+        V::Mul(m2, m2),
+        V::Mul(m1, m2),
+        V::Max(V::Sub(V::Load(sumsq1 + i), V::Mul(m1, m1)), zero),
+        V::Max(V::Sub(V::Load(sumsq2 + i), V::Mul(m2, m2)), zero),
+        V::Sub(V::Load(sum12 + i), V::Mul(m1, m2)),
+    };
+    for (std::size_t j = 0; j < 6; ++j) {
+        V::Store(acc[j] + i, first ? terms[j] : V::Add(V::Load(acc[j] + i), terms[j]));
+    }
+}
+
+template <class V>
+void DssimAt(const float* const* acc, std::size_t i, std::uint32_t qscale, std::uint32_t* out) {
+    using T = typename V::T;
+    const T three = V::Set(3.0f);
+    const T two = V::Set(2.0f);
+    const T c1 = V::Set(kC1);
+    const T c2 = V::Set(kC2);
+    const T mu1Sq = V::Div(V::Load(acc[0] + i), three);
+    const T mu2Sq = V::Div(V::Load(acc[1] + i), three);
+    const T mu1Mu2 = V::Div(V::Load(acc[2] + i), three);
+    const T sigma1Sq = V::Div(V::Load(acc[3] + i), three);
+    const T sigma2Sq = V::Div(V::Load(acc[4] + i), three);
+    const T sigma12 = V::Div(V::Load(acc[5] + i), three);
+    const T numer = V::Mul(V::Add(V::Mul(two, mu1Mu2), c1), V::Add(V::Mul(two, sigma12), c2));
+    const T denom = V::Mul(V::Add(V::Add(mu1Sq, mu2Sq), c1), V::Add(V::Add(sigma1Sq, sigma2Sq), c2));
+    const T ssim = V::Div(numer, denom);
+    const T dssim = V::Min(V::Max(V::Mul(V::Set(0.5f), V::Sub(V::Set(1.0f), ssim)), V::Set(0.0f)), V::Set(1.0f));
+    V::StoreRoundedU32(out + i, V::Mul(dssim, V::Set(static_cast<float>(qscale))));
+}
+
+// Runs body(Vec, i) over [0, n) in V::kWidth steps and the remainder with ScalarVec.
+template <class V, class Body>
+void ForEach(std::size_t n, Body body) {
+    std::size_t i = 0;
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+        body(V{}, i);
+    }
+    for (; i < n; ++i) {
+        body(ScalarVec{}, i);
+    }
+}
+
+template <class V>
+CpuKernels MakeCpuKernels(const char* isa) {
+    CpuKernels kernels = {};
+    kernels.isa = isa;
+    kernels.labRow = [](const float* r, const float* g, const float* b, std::size_t n, float* outL, float* outA,
+                        float* outB) {
+        ForEach<V>(n, [&](auto vec, std::size_t i) {
+            LabAt<decltype(vec)>(r, g, b, i, outL, outA, outB);
+        });
+    };
+    kernels.blurRow = [](const float* src, std::size_t n, float* dst) {
+        ForEach<V>(n, [&](auto vec, std::size_t i) { BlurAt<decltype(vec)>(src, i, dst); });
+    };
+    kernels.momentsRow = [](const float* v1, const float* v2, std::size_t n, float* s1, float* s2, float* q1,
+                            float* q2, float* p12) {
+        ForEach<V>(n, [&](auto vec, std::size_t i) {
+            MomentsAt<decltype(vec)>(v1, v2, i, s1, s2, q1, q2, p12);
+        });
+    };
+    kernels.verticalRow = [](const float* const* rows, std::size_t n, float* dst) {
+        ForEach<V>(n, [&](auto vec, std::size_t i) { VerticalAt<decltype(vec)>(rows, i, dst); });
+    };
+    kernels.accumulateRow = [](const float* mu1, const float* mu2, const float* sumsq1, const float* sumsq2,
+                               const float* sum12, std::size_t n, bool first, float* const* acc) {
+        ForEach<V>(n, [&](auto vec, std::size_t i) {
+            AccumulateAt<decltype(vec)>(mu1, mu2, sumsq1, sumsq2, sum12, i, first, acc);
+        });
+    };
+    kernels.dssimRow = [](const float* const* acc, std::size_t n, std::uint32_t qscale, std::uint32_t* out) {
+        ForEach<V>(n, [&](auto vec, std::size_t i) { DssimAt<decltype(vec)>(acc, i, qscale, out); });
+    };
+    return kernels;
+}
+
+}  // namespace cpu_kernels
@@ -0,0 +1,116 @@
+// Scalar kernels, the CPUID checks and kernel selection. This file is built without ISA
+// flags, so it runs on any host.
+#include <stdexcept>
+
+#include "cpu_kernels_impl.h"
+
+#if defined(DSSIM_X86_KERNELS) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(DSSIM_X86_KERNELS)
+#include <cpuid.h>
+#endif
+
+namespace {
+
+#if !defined(DSSIM_X86_KERNELS)
+// No AVX kernels were built; CpuSupports* report false.
+#elif defined(_MSC_VER)
+#define DSSIM_HAS_CPUID 1
+void Cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) {
+    int out[4];
+    __cpuidex(out, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; ++i) {
+        regs[i] = static_cast<unsigned>(out[i]);
+    }
+}
+unsigned long long Xcr0() { return _xgetbv(0); }
+#else
+#define DSSIM_HAS_CPUID 1
+void Cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) {
+    if (!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3])) {
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    }
+}
+unsigned long long Xcr0() {
+    unsigned lo = 0;
+    unsigned hi = 0;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (static_cast<unsigned long long>(hi) << 32) | lo;
+}
+#endif
+
+#if defined(DSSIM_HAS_CPUID)
+// Leaf 7 EBX, or 0 when the OS has not enabled the register state in `xcr0Mask`.
+unsigned ExtendedFeaturesWithOsSupport(unsigned long long xcr0Mask) {
+    unsigned regs[4] = {};
+    Cpuid(1, 0, regs);
+    constexpr unsigned kOsxsave = 1u << 27;
+    constexpr unsigned kAvx = 1u << 28;
+    if ((regs[2] & (kOsxsave | kAvx)) != (kOsxsave | kAvx) || (Xcr0() & xcr0Mask) != xcr0Mask) {
+        return 0;
+    }
+    Cpuid(0, 0, regs);
+    if (regs[0] < 7) {
+        return 0;
+    }
+    Cpuid(7, 0, regs);
+    return regs[1];
+}
+#endif
+
+}  // namespace
+
+const CpuKernels& ScalarCpuKernels() {
+    static const CpuKernels kernels = cpu_kernels::MakeCpuKernels<cpu_kernels::ScalarVec>("scalar");
+    return kernels;
+}
+
+bool CpuSupportsAvx2() {
+#if defined(DSSIM_HAS_CPUID)
+    // XMM and YMM state.
+    return (ExtendedFeaturesWithOsSupport(0x6) & (1u << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool CpuSupportsAvx512() {
+#if defined(DSSIM_HAS_CPUID)
+    // XMM, YMM, opmask and both halves of the ZMM state; AVX-512F.
+    return (ExtendedFeaturesWithOsSupport(0xE6) & (1u << 16)) != 0;
+#else
+    return false;
+#endif
+}
+
+const CpuKernels& SelectCpuKernels(CpuIsa isa) {
+#if defined(DSSIM_HAS_CPUID)
+    switch (isa) {
+        case CpuIsa::Auto:
+            if (CpuSupportsAvx512()) {
+                return Avx512CpuKernels();
+            }
+            if (CpuSupportsAvx2()) {
+                return Avx2CpuKernels();
+            }
+            return ScalarCpuKernels();
+        case CpuIsa::Avx512:
+            if (!CpuSupportsAvx512()) {
+                throw std::runtime_error("--cpu-isa avx512 requested but the CPU or OS lacks AVX-512F");
+            }
+            return Avx512CpuKernels();
+        case CpuIsa::Avx2:
+            if (!CpuSupportsAvx2()) {
+                throw std::runtime_error("--cpu-isa avx2 requested but the CPU or OS lacks AVX2");
+            }
+            return Avx2CpuKernels();
+        case CpuIsa::Scalar:
+            break;
+    }
+#else
+    if (isa == CpuIsa::Avx512 || isa == CpuIsa::Avx2) {
+        throw std::runtime_error("--cpu-isa avx2/avx512 requested but this build has no x86 kernels");
+    }
+#endif
+    return ScalarCpuKernels();
+}
@@ -1,6 +1,5 @@
 #include <algorithm>
 #include <array>
-#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <cstdint>
@@ -10,20 +9,24 @@
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <numeric>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
-#include <thread>
 #include <utility>
 #include <vector>
-#include <numeric>
 
 #include <dawn/dawn_proc.h>
 #include <dawn/native/DawnNative.h>
 #include <dawn/webgpu_cpp.h>
 
+#include "autotune_cache.h"
+#include "cpu_backend.h"
+#include "gpu_buffer_pool.h"
 #include "png_loader.h"
+#include "thread_pool.h"
 using namespace std::chrono;
 namespace {
 
@@ -31,6 +34,27 @@ constexpr std::uint32_t kStage0QScale = 100000000u;
 constexpr std::uint32_t kStage0WindowRadius = 2u;
 constexpr std::uint32_t kStage0WindowSize = kStage0WindowRadius * 2u + 1u;
 constexpr std::array<double, 5> kDefaultScaleWeights = {0.028, 0.197, 0.322, 0.298, 0.155};
+// Pyramid levels produced by one downsample_pyramid.wgsl dispatch, and the level-0 edge
+// each of its workgroups covers.
+constexpr std::uint32_t kPyramidMaxLevels = 4u;
+constexpr std::uint32_t kPyramidRegionSize = 64u;
+static_assert(kDefaultScaleWeights.size() - 1 <= kPyramidMaxLevels);
+// Below this many pixels, per-dispatch overhead outweighs a level's work (levels 2-4 of a
+// 1440p input).
+constexpr std::uint32_t kDefaultLevelBatchPixels = 262144u;
+// WebGPU's default maxComputeWorkgroupsPerDimension; bounds the tiles of one batch.
+constexpr std::uint32_t kMaxWorkgroupsPerDimension = 65535u;
+constexpr std::uint64_t kSrgbLutBytes = 256u * sizeof(float);
+// --autotune candidates for ReduceTuning; every combination is timed.
+constexpr std::array<std::uint32_t, 3> kAutotuneWorkgroupSizes = {64u, 128u, 256u};
+constexpr std::array<std::uint32_t, 3> kAutotuneMaxGroups = {64u, 128u, 256u};
+// --autotune candidates for both StageTuning tiles, each timed where its workgroup memory
+// fits the device.
+constexpr std::array<TileShape, 4> kAutotuneTileShapes = {{{16u, 16u}, {16u, 8u}, {8u, 16u}, {8u, 8u}}};
+// Timed runs per candidate; the fastest one counts.
+constexpr std::uint32_t kAutotuneRepetitions = 8u;
+// Pixels per work item of the host-side per-pixel loops on the thread pool.
+constexpr std::size_t kHostChunkPixels = 65536u;
 
 struct LinearRgba {
     float r = 0.0f;
@@ -45,6 +69,31 @@ struct CliOptions {
     std::filesystem::path out;
     std::filesystem::path debugDumpDir;
     bool debugDumpEnabled = false;
+    // Level 0 and the pyramid live in textures instead of storage buffers.
+    bool textureInput = false;
+    // Extra timed comparisons after the first; 0 disables the benchmark.
+    std::uint32_t benchIterations = 0;
+    // Also time the CPU engine in a GPU benchmark; a CPU run always times it.
+    bool benchCpu = false;
+    // Pyramid levels with fewer pixels than this are scored together by one batched
+    // dispatch; 0 disables batching.
+    std::uint32_t levelBatchPixels = kDefaultLevelBatchPixels;
+    // Store the Lab planes as f16 when the adapter supports shader-f16.
+    bool labF16 = false;
+    // Use the subgroup reduce entry points when the adapter supports subgroups.
+    bool subgroups = true;
+    // Request the fallback (software) adapter, e.g. SwiftShader.
+    bool fallbackAdapter = false;
+    // Time the reduce launch configurations and stage tiles and store the fastest in the
+    // autotune cache.
+    bool autotune = false;
+    // Defaults to DefaultAutotuneCachePath().
+    std::filesystem::path autotuneCache;
+    // Score on the CPU (cpu_backend.h) instead of creating a Dawn device.
+    bool cpuBackend = false;
+    CpuIsa cpuIsa = CpuIsa::Auto;
+    // Threads for the CPU engine and the host-side loops; 0 uses DefaultThreadCount().
+    unsigned threads = 0;
 };
 
 struct ScaleOutputs {
@@ -57,14 +106,12 @@ struct ScaleOutputs {
     std::vector<float> var2;
     std::vector<float> cov12;
     std::uint64_t dssimQSum = 0;
+    std::size_t elemCount = 0;
     double meanDssim = 0.0;
     double ssimScore = 0.0;
     // profiling
-    std::chrono::milliseconds createShaderModule_time;
-    std::chrono::milliseconds createPSO_time;
     std::chrono::milliseconds createBuffers_time;
     std::chrono::milliseconds writeInputBuffers_time;
-    std::chrono::milliseconds createPipelineLayouts_time;
     std::chrono::milliseconds createBindGroups_time;
     std::chrono::milliseconds dispatchAndSubmit_time;
     std::chrono::milliseconds readback_time;
@@ -100,20 +147,169 @@ struct DecodedInputInfo {
     std::size_t byteCount = 0;
 };
 
-struct DownsampleOutputs {
+enum class GpuPixelFormat {
+    // Decoder output uploaded as-is, one u32 per pixel; unpacked by the first shader.
+    Rgba8,
+    // LinearRgba, as produced on the GPU by the downsample pass.
+    Rgba32Float,
+};
+
+// One pyramid level of one input image, resident in a GPU storage buffer. The buffer is
+// owned by the GpuFrame the level is recorded in; pyramid levels share one buffer per
+// image and start at bufferOffset.
+struct GpuImage {
     std::uint32_t width = 0;
     std::uint32_t height = 0;
-    std::vector<LinearRgba> pixels;
+    GpuPixelFormat format = GpuPixelFormat::Rgba32Float;
+    wgpu::Buffer buffer;
+    std::uint64_t bufferOffset = 0;
+
+    // Texture-backed images (--input-path texture). view is read by the downsample;
+    // decodeView is read by the Lab conversion and is the rgba8unorm-srgb view at level 0,
+    // so the hardware performs the sRGB decode.
+    bool textureBacked = false;
+    wgpu::TextureView view;
+    wgpu::TextureView decodeView;
+
+    std::size_t pixelCount() const {
+        return static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+    }
+
+    std::size_t byteSize() const {
+        const std::size_t bytesPerPixel = (format == GpuPixelFormat::Rgba8) ? 4u : sizeof(LinearRgba);
+        return pixelCount() * bytesPerPixel;
+    }
+};
+
+// Pyramid levels 1.. of both images, produced by one dispatch; levels[k - 1][i] is level k
+// of image i.
+struct DownsampleOutputs {
+    std::vector<std::array<GpuImage, 2>> levels;
+    // Storage behind levels: one buffer of bufferBytes per image, or the two-layer pyramid
+    // texture.
+    std::array<wgpu::Buffer, 2> buffers;
+    std::uint64_t bufferBytes = 0;
+    wgpu::Texture texture;
+    // Level 1 of each image, as handles into the GpuFrame readback buffer; only scheduled
+    // when a debug dump asks for it.
+    std::array<std::size_t, 2> pixelsReadback = {};
+    bool hasPixelsReadback = false;
+    // Bytes per row in the readback; texture copies pad rows to 256 bytes.
+    std::size_t pixelsRowPitch = 0;
     // profiling
-    std::chrono::milliseconds createShaderModule_time;
-    std::chrono::milliseconds createPSO_time;
-    std::chrono::milliseconds createBuffers_time;
-    std::chrono::milliseconds writeInputBuffers_time;
-    std::chrono::milliseconds createPipelineLayouts_time;
-    std::chrono::milliseconds createBindGroups_time;
-    std::chrono::milliseconds dispatchAndSubmit_time;
-    std::chrono::milliseconds readback_time;
-    std::chrono::milliseconds postProcess_time;
+    std::chrono::milliseconds createBuffers_time{0};
+    std::chrono::milliseconds writeInputBuffers_time{0};
+    std::chrono::milliseconds createBindGroups_time{0};
+    std::chrono::milliseconds dispatchAndSubmit_time{0};
+};
+
+// Host mirror of LevelStats in ssim_reduce.wgsl.
+struct LevelStatsData {
+    std::uint64_t sum = 0;
+    std::uint32_t threshold = 0;
+    std::uint32_t hiCount = 0;
+    std::uint64_t hiSum = 0;
+    std::uint64_t padding = 0;
+};
+static_assert(sizeof(LevelStatsData) == 32);
+
+struct ShaderSources {
+    // Lab conversion, blur weights and the dssim formula shared by preprocess, stage0 and fused.
+    std::string common;
+    std::string preprocess;
+    std::string stage0;
+    std::string fused;
+    std::string downsample;
+    std::string reduce;
+    // Appended to reduce when the device has subgroups; see ssim_reduce_subgroups.wgsl.
+    std::string reduceSubgroups;
+};
+
+// The four ssim_reduce.wgsl passes, in dispatch order, built for one ReduceTuning.
+struct ReducePipelines {
+    ReduceTuning tuning;
+    wgpu::ComputePipeline sumPartials;
+    wgpu::ComputePipeline sumFinal;
+    wgpu::ComputePipeline partitionPartials;
+    wgpu::ComputePipeline partitionFinal;
+};
+
+// Long-lived GPU state shared by every scale level and comparison. Shader modules,
+// bind group layouts and pipelines are built once here; per-level work only creates
+// buffers and bind groups.
+struct GpuContext {
+    wgpu::Instance instance;
+    wgpu::Adapter adapter;
+    wgpu::Device device;
+    wgpu::Queue queue;
+    std::string adapterName = "unknown";
+    // The three Lab planes per image hold lab_t = f16 (6 bytes per pixel per image) instead
+    // of f32 (12 bytes). Only set when requested and the device was created with ShaderF16.
+    bool labF16 = false;
+    // The device was created with Subgroups and subgroupReduce holds the *_subgroup
+    // pipelines; otherwise subgroupReduce is a copy of reduce (workgroup memory tree).
+    bool subgroups = false;
+    // The device was created with TimestampQuery (only requested for --autotune).
+    bool timestampQuery = false;
+    // Identifies the adapter in the autotune cache; see AdapterCacheKey.
+    std::string adapterKey;
+    // The device's maxComputeWorkgroupStorageSize, which bounds the StageTuning tiles.
+    std::uint32_t maxWorkgroupStorageSize = 16384u;
+
+    // The convert and downsample layouts bind the second image at binding 3 (and its
+    // downsample output at 4); each dispatch covers both images with z = 2. The convert
+    // layout binds srgbLut at 4.
+    wgpu::BindGroupLayout preprocessConvertBgl;
+    wgpu::ComputePipeline preprocessConvertPipeline;
+    wgpu::ComputePipeline preprocessConvertRgba8Pipeline;
+    wgpu::BindGroupLayout preprocessBgl;
+    wgpu::ComputePipeline preprocessBlurPipeline;
+    // Lab conversion reading a texture; the srgb8 variant relies on the rgba8unorm-srgb view.
+    wgpu::BindGroupLayout preprocessTextureBgl;
+    wgpu::ComputePipeline preprocessConvertTexturePipeline;
+    wgpu::ComputePipeline preprocessConvertTextureSrgb8Pipeline;
+    wgpu::BindGroupLayout stage0Bgl;
+    wgpu::ComputePipeline stage0Pipeline;
+    // Same shader with the mu/var/cov debug planes bound and written; used for debug dumps.
+    wgpu::BindGroupLayout stage0DebugBgl;
+    wgpu::ComputePipeline stage0DebugPipeline;
+    // Lab conversion, blur and stage0 in one dispatch, reusing the preprocessConvertBgl and
+    // preprocessTextureBgl layouts with the dssim map at binding 1.
+    wgpu::ComputePipeline fusedPipeline;
+    wgpu::ComputePipeline fusedRgba8Pipeline;
+    wgpu::ComputePipeline fusedTexturePipeline;
+    wgpu::ComputePipeline fusedTextureSrgb8Pipeline;
+    // Several small pyramid levels per dispatch (main_batched*), same layouts.
+    wgpu::ComputePipeline fusedBatchedPipeline;
+    wgpu::ComputePipeline fusedBatchedTexturePipeline;
+    // Kept so that ApplyStageTuning can rebuild the pipelines above; stageTuning is the
+    // tiles they were built with, which the dispatches must match.
+    wgpu::ShaderModule preprocessShader;
+    wgpu::ShaderModule stage0Shader;
+    wgpu::ShaderModule fusedShader;
+    StageTuning stageTuning;
+    // Packed RGBA8 level 0 in, every pyramid level out; see downsample_pyramid.wgsl.
+    wgpu::BindGroupLayout downsampleBgl;
+    wgpu::ComputePipeline downsamplePipeline;
+    // Texture in, pyramid mips (storage textures) out.
+    wgpu::BindGroupLayout downsampleTextureBgl;
+    wgpu::ComputePipeline downsampleTexturePipeline;
+    wgpu::BindGroupLayout reduceBgl;
+    // Kept so that ApplyReduceTuning can rebuild the reduce pipelines.
+    wgpu::ShaderModule reduceShader;
+    wgpu::ShaderModule subgroupReduceShader;
+    ReducePipelines reduce;
+    ReducePipelines subgroupReduce;
+
+    // 256 f32: linear value of each sRGB byte, for the packed RGBA8 entry points.
+    wgpu::Buffer srgbLut;
+
+    GpuBufferPool bufferPool;
+
+    // profiling (paid once per process)
+    std::chrono::milliseconds createShaderModule_time{0};
+    std::chrono::milliseconds createPSO_time{0};
+    std::chrono::milliseconds createPipelineLayouts_time{0};
 };
 
 std::string EscapeJson(const std::string& input) {
@@ -210,7 +406,10 @@ CliOptions ParseArgs(int argc, char** argv) {
     if (argc < 3) {
         throw std::runtime_error(
             "usage: dssim_gpu_dawn_checksum <img1> <img2> [--out <json>] "
-            "[--debug-dump-dir <dir>]");
+            "[--debug-dump-dir <dir>] [--input-path buffer|texture] [--bench-iterations <n>] [--bench-cpu] "
+            "[--lab-precision f32|f16] [--level-batch-pixels <n>] [--subgroups auto|off] "
+            "[--adapter default|fallback] [--autotune] [--autotune-cache <path>] [--backend gpu|cpu] "
+            "[--cpu-isa auto|avx512|avx2|scalar] [--threads auto|<n>]");
     }
 
     CliOptions options;
@@ -246,6 +445,210 @@ CliOptions ParseArgs(int argc, char** argv) {
             continue;
         }
 
+        if (arg == "--input-path" || arg.rfind("--input-path=", 0) == 0) {
+            std::string value;
+            if (arg == "--input-path") {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value for --input-path");
+                }
+                value = argv[++i];
+            } else {
+                value = arg.substr(std::string("--input-path=").size());
+            }
+            if (value == "buffer") {
+                options.textureInput = false;
+            } else if (value == "texture") {
+                options.textureInput = true;
+            } else {
+                throw std::runtime_error("invalid --input-path (expected buffer or texture): " + value);
+            }
+            continue;
+        }
+
+        if (arg == "--lab-precision" || arg.rfind("--lab-precision=", 0) == 0) {
+            std::string value;
+            if (arg == "--lab-precision") {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value for --lab-precision");
+                }
+                value = argv[++i];
+            } else {
+                value = arg.substr(std::string("--lab-precision=").size());
+            }
+            if (value == "f32") {
+                options.labF16 = false;
+            } else if (value == "f16") {
+                options.labF16 = true;
+            } else {
+                throw std::runtime_error("invalid --lab-precision (expected f32 or f16): " + value);
+            }
+            continue;
+        }
+
+        if (arg == "--bench-iterations" || arg.rfind("--bench-iterations=", 0) == 0) {
+            std::string value;
+            if (arg == "--bench-iterations") {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value for --bench-iterations");
+                }
+                value = argv[++i];
+            } else {
+                value = arg.substr(std::string("--bench-iterations=").size());
+            }
+            try {
+                options.benchIterations = static_cast<std::uint32_t>(std::stoul(value));
+            } catch (const std::exception&) {
+                throw std::runtime_error("invalid --bench-iterations: " + value);
+            }
+            continue;
+        }
+
+        if (arg == "--bench-cpu") {
+            options.benchCpu = true;
+            continue;
+        }
+
+        if (arg == "--level-batch-pixels" || arg.rfind("--level-batch-pixels=", 0) == 0) {
+            std::string value;
+            if (arg == "--level-batch-pixels") {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value for --level-batch-pixels");
+                }
+                value = argv[++i];
+            } else {
+                value = arg.substr(std::string("--level-batch-pixels=").size());
+            }
+            try {
+                options.levelBatchPixels = static_cast<std::uint32_t>(std::stoul(value));
+            } catch (const std::exception&) {
+                throw std::runtime_error("invalid --level-batch-pixels: " + value);
+            }
+            continue;
+        }
+
+        if (arg == "--subgroups" || arg.rfind("--subgroups=", 0) == 0) {
+            std::string value;
+            if (arg == "--subgroups") {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value for --subgroups");
+                }
+                value = argv[++i];
+            } else {
+                value = arg.substr(std::string("--subgroups=").size());
+            }
+            if (value == "auto") {
+                options.subgroups = true;
+            } else if (value == "off") {
+                options.subgroups = false;
+            } else {
+                throw std::runtime_error("invalid --subgroups (expected auto or off): " + value);
+            }
+            continue;
+        }
+
+        if (arg == "--adapter" || arg.rfind("--adapter=", 0) == 0) {
+            std::string value;
+            if (arg == "--adapter") {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value for --adapter");
+                }
+                value = argv[++i];
+            } else {
+                value = arg.substr(std::string("--adapter=").size());
+            }
+            if (value == "default") {
+                options.fallbackAdapter = false;
+            } else if (value == "fallback") {
+                options.fallbackAdapter = true;
+            } else {
+                throw std::runtime_error("invalid --adapter (expected default or fallback): " + value);
+            }
+            continue;
+        }
+
+        if (arg == "--autotune") {
+            options.autotune = true;
+            continue;
+        }
+
+        if (arg == "--autotune-cache") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("missing value for --autotune-cache");
+            }
+            options.autotuneCache = argv[++i];
+            continue;
+        }
+        if (arg.rfind("--autotune-cache=", 0) == 0) {
+            options.autotuneCache = arg.substr(std::string("--autotune-cache=").size());
+            continue;
+        }
+
+        if (arg == "--backend" || arg.rfind("--backend=", 0) == 0) {
+            std::string value;
+            if (arg == "--backend") {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value for --backend");
+                }
+                value = argv[++i];
+            } else {
+                value = arg.substr(std::string("--backend=").size());
+            }
+            if (value == "gpu") {
+                options.cpuBackend = false;
+            } else if (value == "cpu") {
+                options.cpuBackend = true;
+            } else {
+                throw std::runtime_error("invalid --backend (expected gpu or cpu): " + value);
+            }
+            continue;
+        }
+
+        if (arg == "--cpu-isa" || arg.rfind("--cpu-isa=", 0) == 0) {
+            std::string value;
+            if (arg == "--cpu-isa") {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value for --cpu-isa");
+                }
+                value = argv[++i];
+            } else {
+                value = arg.substr(std::string("--cpu-isa=").size());
+            }
+            if (value == "auto") {
+                options.cpuIsa = CpuIsa::Auto;
+            } else if (value == "avx512") {
+                options.cpuIsa = CpuIsa::Avx512;
+            } else if (value == "avx2") {
+                options.cpuIsa = CpuIsa::Avx2;
+            } else if (value == "scalar") {
+                options.cpuIsa = CpuIsa::Scalar;
+            } else {
+                throw std::runtime_error("invalid --cpu-isa (expected auto, avx512, avx2 or scalar): " + value);
+            }
+            continue;
+        }
+
+        if (arg == "--threads" || arg.rfind("--threads=", 0) == 0) {
+            std::string value;
+            if (arg == "--threads") {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value for --threads");
+                }
+                value = argv[++i];
+            } else {
+                value = arg.substr(std::string("--threads=").size());
+            }
+            if (value == "auto") {
+                options.threads = 0;
+            } else {
+                try {
+                    options.threads = static_cast<unsigned>(std::stoul(value));
+                } catch (const std::exception&) {
+                    throw std::runtime_error("invalid --threads (expected auto or a count): " + value);
+                }
+            }
+            continue;
+        }
+
         throw std::runtime_error("unknown argument: " + arg);
     }
 
@@ -268,36 +671,23 @@ std::uint8_t ToUnorm8(float value) {
     return static_cast<std::uint8_t>(std::lround(clamped * 255.0f));
 }
 
-std::vector<LinearRgba> ConvertRgba8ToLinearPlu(const std::vector<std::uint8_t>& bytes) {
-    if ((bytes.size() % 4) != 0) {
-        throw std::runtime_error("rgba8 byte count is not divisible by 4");
-    }
-
-    const std::size_t pixelCount = bytes.size() / 4;
-    std::vector<LinearRgba> out(pixelCount);
-    for (std::size_t i = 0; i < pixelCount; ++i) {
-        const std::size_t base = i * 4;
-        out[i].r = static_cast<float>(bytes[base + 0]) / 255.0f;
-        out[i].g = static_cast<float>(bytes[base + 1]) / 255.0f;
-        out[i].b = static_cast<float>(bytes[base + 2]) / 255.0f;
-        out[i].a = static_cast<float>(bytes[base + 3]) / 255.0f;
-    }
-    return out;
-}
-
-std::vector<std::uint8_t> ConvertLinearPluToRgba8(const std::vector<LinearRgba>& pixels) {
+std::vector<std::uint8_t> ConvertLinearPluToRgba8(const std::vector<LinearRgba>& pixels, ThreadPool& pool) {
     std::vector<std::uint8_t> out(pixels.size() * 4);
-    for (std::size_t i = 0; i < pixels.size(); ++i) {
-        const float a = std::clamp(pixels[i].a, 0.0f, 1.0f);
-        const float invA = (a > 1.0e-8f) ? (1.0f / a) : 0.0f;
-        const float r = std::clamp(pixels[i].r * invA, 0.0f, 1.0f);
-        const float g = std::clamp(pixels[i].g * invA, 0.0f, 1.0f);
-        const float b = std::clamp(pixels[i].b * invA, 0.0f, 1.0f);
-        out[i * 4 + 0] = ToUnorm8(LinearToSrgb(r));
-        out[i * 4 + 1] = ToUnorm8(LinearToSrgb(g));
-        out[i * 4 + 2] = ToUnorm8(LinearToSrgb(b));
-        out[i * 4 + 3] = ToUnorm8(a);
-    }
+    const std::size_t chunks = (pixels.size() + kHostChunkPixels - 1) / kHostChunkPixels;
+    pool.ParallelFor(static_cast<std::uint32_t>(chunks), [&](std::uint32_t chunk) {
+        const std::size_t end = std::min(pixels.size(), (chunk + 1u) * kHostChunkPixels);
+        for (std::size_t i = chunk * kHostChunkPixels; i < end; ++i) {
+            const float a = std::clamp(pixels[i].a, 0.0f, 1.0f);
+            const float invA = (a > 1.0e-8f) ? (1.0f / a) : 0.0f;
+            const float r = std::clamp(pixels[i].r * invA, 0.0f, 1.0f);
+            const float g = std::clamp(pixels[i].g * invA, 0.0f, 1.0f);
+            const float b = std::clamp(pixels[i].b * invA, 0.0f, 1.0f);
+            out[i * 4 + 0] = ToUnorm8(LinearToSrgb(r));
+            out[i * 4 + 1] = ToUnorm8(LinearToSrgb(g));
+            out[i * 4 + 2] = ToUnorm8(LinearToSrgb(b));
+            out[i * 4 + 3] = ToUnorm8(a);
+        }
+    });
     return out;
 }
 
@@ -371,6 +761,7 @@ void WriteU8Buffer(const std::filesystem::path& outPath, const std::vector<std::
 std::string BuildJson(
     const CliOptions& options,
     const std::string& adapterName,
+    bool labF16,
     const DecodedInputInfo& decoded1,
     const DecodedInputInfo& decoded2,
     const MultiScaleOutputs& compute,
@@ -391,11 +782,47 @@ std::string BuildJson(
         const auto absDebug = std::filesystem::absolute(options.debugDumpDir).string();
         command << " --debug-dump-dir \"" << absDebug << "\"";
     }
+    if (options.textureInput) {
+        command << " --input-path texture";
+    }
+    if (options.levelBatchPixels != kDefaultLevelBatchPixels) {
+        command << " --level-batch-pixels " << options.levelBatchPixels;
+    }
+    if (options.labF16) {
+        command << " --lab-precision f16";
+    }
+    if (!options.subgroups) {
+        command << " --subgroups off";
+    }
+    if (options.fallbackAdapter) {
+        command << " --adapter fallback";
+    }
+    if (options.cpuBackend) {
+        command << " --backend cpu";
+    }
+    switch (options.cpuIsa) {
+        case CpuIsa::Auto:
+            break;
+        case CpuIsa::Avx512:
+            command << " --cpu-isa avx512";
+            break;
+        case CpuIsa::Avx2:
+            command << " --cpu-isa avx2";
+            break;
+        case CpuIsa::Scalar:
+            command << " --cpu-isa scalar";
+            break;
+    }
+    if (options.threads != 0) {
+        command << " --threads " << options.threads;
+    }
 
+    const char* engine = options.cpuBackend ? "cpu-dssim-ms-stage5x5-gaussian-linear"
+                                            : "gpu-dawn-wgsl-dssim-ms-stage5x5-gaussian-linear";
     std::ostringstream os;
     os << "{\n";
     os << "  \"schema_version\": 1,\n";
-    os << "  \"engine\": \"gpu-dawn-wgsl-dssim-ms-stage5x5-gaussian-linear\",\n";
+    os << "  \"engine\": \"" << engine << "\",\n";
     os << "  \"status\": \"ok\",\n";
     os << "  \"input\": {\n";
     os << "    \"image1\": \"" << EscapeJson(abs1) << "\",\n";
@@ -421,6 +848,7 @@ std::string BuildJson(
     std::ostringstream scoreText;
     scoreText << std::fixed << std::setprecision(8) << compute.score;
     os << "    \"score_source\": \"gpu-reference-like-ms-ssim-provisional\",\n";
+    os << "    \"lab_precision\": \"" << (labF16 ? "f16" : "f32") << "\",\n";
     os << "    \"score_text\": \"" << scoreText.str() << "\",\n";
     os << "    \"score_f64\": " << std::setprecision(17) << compute.score << ",\n";
     os << "    \"score_bits_u64\": \"" << ToHexU64(compute.score) << "\",\n";
@@ -439,7 +867,7 @@ std::string BuildJson(
         os << "        \"qscale\": " << kStage0QScale << ",\n";
         os << "        \"weight\": " << std::setprecision(17) << kDefaultScaleWeights[i] << ",\n";
         os << "        \"sum_u64\": " << scale.dssimQSum << ",\n";
-        os << "        \"elem_count\": " << scale.dssimQ.size() << ",\n";
+        os << "        \"elem_count\": " << scale.elemCount << ",\n";
         os << "        \"mean_dssim_f64\": " << std::setprecision(17) << scale.meanDssim << ",\n";
         os << "        \"ssim_score_f64\": " << std::setprecision(17) << scale.ssimScore << "\n";
         os << "      }";
@@ -565,32 +993,46 @@ wgpu::ShaderModule CreateShaderModule(const wgpu::Device& device, const std::str
     return device.CreateShaderModule(&shaderDesc);
 }
 
+// Blocks until every future has completed. Callbacks registered with
+// CallbackMode::WaitAnyOnly fire on this thread from inside WaitAny, so the caller's
+// state needs no synchronization. Requires the instance's TimedWaitAny feature.
+void WaitAllBlocking(const wgpu::Instance& instance, std::vector<wgpu::FutureWaitInfo>& waits, const char* what) {
+    std::size_t pending = waits.size();
+    while (pending > 0) {
+        const wgpu::WaitStatus status =
+            instance.WaitAny(waits.size(), waits.data(), std::numeric_limits<std::uint64_t>::max());
+        if (status != wgpu::WaitStatus::Success) {
+            throw std::runtime_error(std::string("WaitAny failed while waiting for ") + what);
+        }
+        // Completed entries are dropped so the next WaitAny only sees outstanding futures.
+        waits.erase(
+            std::remove_if(waits.begin(), waits.end(), [](const wgpu::FutureWaitInfo& w) { return w.completed; }),
+            waits.end());
+        pending = waits.size();
+    }
+}
+
 std::vector<std::uint8_t> ReadBufferBlocking(
     const wgpu::Instance& instance,
-    wgpu::Buffer& buffer,
+    const wgpu::Buffer& buffer,
     std::size_t byteSize) {
     struct MapState {
-        std::atomic<bool> done{false};
         wgpu::MapAsyncStatus status = wgpu::MapAsyncStatus::Error;
         std::string message;
     };
     MapState mapState;
 
-    buffer.MapAsync(
+    std::vector<wgpu::FutureWaitInfo> waits(1);
+    waits[0].future = buffer.MapAsync(
         wgpu::MapMode::Read,
         0,
         static_cast<std::uint64_t>(byteSize),
-        wgpu::CallbackMode::AllowProcessEvents,
+        wgpu::CallbackMode::WaitAnyOnly,
         [&mapState](wgpu::MapAsyncStatus status, const char* message) {
             mapState.status = status;
             mapState.message = (message != nullptr) ? std::string(message) : std::string();
-            mapState.done.store(true, std::memory_order_release);
         });
-
-    while (!mapState.done.load(std::memory_order_acquire)) {
-        instance.ProcessEvents();
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
+    WaitAllBlocking(instance, waits, "readback MapAsync");
 
     if (mapState.status != wgpu::MapAsyncStatus::Success) {
         std::string message = "readback MapAsync failed";
@@ -614,39 +1056,428 @@ std::vector<std::uint8_t> ReadBufferBlocking(
     return data;
 }
 
-ScaleOutputs RunStage0Compute(
-    const wgpu::Instance& instance,
+// Creates the two-layer rgba32float texture holding pyramid levels 1..mipCount of both
+// images: level k of image i is mip k - 1 of layer i.
+wgpu::Texture CreatePyramidTexture(
+    GpuContext& ctx,
+    std::uint32_t width,
+    std::uint32_t height,
+    std::uint32_t mipCount) {
+    wgpu::TextureDescriptor desc = {};
+    desc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::StorageBinding |
+                 wgpu::TextureUsage::CopySrc;
+    desc.dimension = wgpu::TextureDimension::e2D;
+    desc.size = {width, height, 2};
+    desc.format = wgpu::TextureFormat::RGBA32Float;
+    desc.mipLevelCount = mipCount;
+    wgpu::Texture texture = ctx.device.CreateTexture(&desc);
+    if (!texture) {
+        throw std::runtime_error("failed to create pyramid texture");
+    }
+    return texture;
+}
+
+// Level mip + 1 of image `layer`, backed by a single-mip, single-layer view of the pyramid
+// texture.
+GpuImage PyramidLevelImage(
+    const wgpu::Texture& pyramid,
+    std::uint32_t layer,
+    std::uint32_t mip,
+    std::uint32_t width,
+    std::uint32_t height) {
+    wgpu::TextureViewDescriptor viewDesc = {};
+    viewDesc.dimension = wgpu::TextureViewDimension::e2D;
+    viewDesc.baseMipLevel = mip;
+    viewDesc.mipLevelCount = 1;
+    viewDesc.baseArrayLayer = layer;
+    viewDesc.arrayLayerCount = 1;
+    GpuImage image;
+    image.width = width;
+    image.height = height;
+    image.format = GpuPixelFormat::Rgba32Float;
+    image.textureBacked = true;
+    image.view = pyramid.CreateView(&viewDesc);
+    image.decodeView = image.view;
+    return image;
+}
+
+// Uploads decoded RGBA8 pixels into an rgba8unorm texture that can also be viewed as
+// rgba8unorm-srgb.
+GpuImage UploadTextureImage(GpuContext& ctx, const DecodedImage& decoded) {
+    const wgpu::TextureFormat srgbFormat = wgpu::TextureFormat::RGBA8UnormSrgb;
+    wgpu::TextureDescriptor desc = {};
+    desc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst;
+    desc.dimension = wgpu::TextureDimension::e2D;
+    desc.size = {decoded.width, decoded.height, 1};
+    desc.format = wgpu::TextureFormat::RGBA8Unorm;
+    desc.mipLevelCount = 1;
+    desc.viewFormatCount = 1;
+    desc.viewFormats = &srgbFormat;
+    wgpu::Texture texture = ctx.device.CreateTexture(&desc);
+    if (!texture) {
+        throw std::runtime_error("failed to create input texture");
+    }
+
+    wgpu::TexelCopyTextureInfo destination = {};
+    destination.texture = texture;
+    wgpu::TexelCopyBufferLayout layout = {};
+    layout.bytesPerRow = decoded.width * 4u;
+    layout.rowsPerImage = decoded.height;
+    const wgpu::Extent3D extent = {decoded.width, decoded.height, 1};
+    ctx.queue.WriteTexture(&destination, decoded.pixels.data(), decoded.pixels.size(), &layout, &extent);
+
+    wgpu::TextureViewDescriptor srgbViewDesc = {};
+    srgbViewDesc.format = srgbFormat;
+    srgbViewDesc.dimension = wgpu::TextureViewDimension::e2D;
+    GpuImage image;
+    image.width = decoded.width;
+    image.height = decoded.height;
+    image.format = GpuPixelFormat::Rgba8;
+    image.textureBacked = true;
+    image.view = texture.CreateView();
+    image.decodeView = texture.CreateView(&srgbViewDesc);
+    return image;
+}
+
+// Either a buffer binding (buffer, size[, offset]) or a texture view binding.
+struct BindingResource {
+    wgpu::Buffer buffer = {};
+    std::uint64_t size = 0;
+    std::uint64_t offset = 0;
+    wgpu::TextureView textureView = {};
+};
+
+// Binds resources[i] at binding i, matching CreateBufferBindGroupLayout and
+// CreateTextureInputBindGroupLayout.
+wgpu::BindGroup CreateBindGroup(
     const wgpu::Device& device,
-    const std::vector<LinearRgba>& input1,
-    const std::vector<LinearRgba>& input2,
+    const wgpu::BindGroupLayout& layout,
+    const std::vector<BindingResource>& resources,
+    const char* what) {
+    std::vector<wgpu::BindGroupEntry> entries(resources.size());
+    for (std::size_t i = 0; i < resources.size(); ++i) {
+        entries[i].binding = static_cast<std::uint32_t>(i);
+        if (resources[i].textureView) {
+            entries[i].textureView = resources[i].textureView;
+            continue;
+        }
+        entries[i].buffer = resources[i].buffer;
+        entries[i].offset = resources[i].offset;
+        entries[i].size = resources[i].size;
+    }
+
+    wgpu::BindGroupDescriptor bgDesc = {};
+    bgDesc.layout = layout;
+    bgDesc.entryCount = entries.size();
+    bgDesc.entries = entries.data();
+    wgpu::BindGroup bindGroup = device.CreateBindGroup(&bgDesc);
+    if (!bindGroup) {
+        throw std::runtime_error(std::string("failed to create ") + what + " bind group");
+    }
+    return bindGroup;
+}
+
+// Records every pass of one comparison into a single command encoder so that the whole
+// multi-scale pyramid costs one Submit and one MapAsync.
+//
+// Buffers written with queue.WriteBuffer and buffers scheduled for readback are retained
+// until the submit completes: queue writes land before the command buffer runs, and
+// readback copies are recorded at the very end. Every other pooled buffer may go back to
+// the pool as soon as its pass is recorded, because passes inside one command buffer
+// execute in order and a later level reusing it is therefore safe.
+class GpuFrame {
+public:
+    explicit GpuFrame(GpuContext& ctx) : ctx_(ctx), encoder_(ctx.device.CreateCommandEncoder()) {
+        if (!encoder_) {
+            throw std::runtime_error("failed to create command encoder");
+        }
+    }
+
+    const wgpu::CommandEncoder& encoder() const { return encoder_; }
+
+    // Returned by value: retained_ may reallocate, so references into it do not stay valid.
+    wgpu::Buffer Upload(wgpu::BufferUsage usage, const void* data, std::size_t size) {
+        PooledBuffer buffer = ctx_.bufferPool.Acquire(usage | wgpu::BufferUsage::CopyDst, size);
+        ctx_.queue.WriteBuffer(buffer.Get(), 0, data, size);
+        retained_.push_back(std::move(buffer));
+        return retained_.back().Get();
+    }
+
+    // Takes ownership of source and schedules a copy of its first `size` bytes into the
+    // frame's readback buffer. Returns a handle for ReadbackBytes().
+    std::size_t ScheduleReadback(PooledBuffer source, std::uint64_t size) {
+        const std::size_t handle = ScheduleReadback(source.Get(), size);
+        retained_.push_back(std::move(source));
+        return handle;
+    }
+
+    // Same, for a buffer the caller keeps alive (e.g. through Keep).
+    std::size_t ScheduleReadback(const wgpu::Buffer& source, std::uint64_t size) {
+        Readback readback;
+        readback.source = source;
+        readback.offset = readbackBytes_;
+        readback.size = size;
+        readbackBytes_ += (size + 7u) & ~std::uint64_t{7};
+        readbacks_.push_back(readback);
+        return readbacks_.size() - 1;
+    }
+
+    // Keeps buffer out of the pool until the submit completes.
+    wgpu::Buffer Retain(PooledBuffer buffer) {
+        retained_.push_back(std::move(buffer));
+        return retained_.back().Get();
+    }
+
+    // Keeps buffer out of the pool for the lifetime of the frame, past SubmitAndWait, so
+    // that a later frame can still read it.
+    wgpu::Buffer Keep(PooledBuffer buffer) {
+        kept_.push_back(std::move(buffer));
+        return kept_.back().Get();
+    }
+
+    void SubmitAndWait() {
+        const auto start_Submit = std::chrono::steady_clock::now();
+        PooledBuffer readbackBuffer;
+        if (readbackBytes_ > 0) {
+            readbackBuffer = ctx_.bufferPool.Acquire(
+                wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead, readbackBytes_);
+            for (const Readback& readback : readbacks_) {
+                encoder_.CopyBufferToBuffer(
+                    readback.source, 0, readbackBuffer.Get(), readback.offset, readback.size);
+            }
+        }
+        wgpu::CommandBuffer commandBuffer = encoder_.Finish();
+        ctx_.queue.Submit(1, &commandBuffer);
+        const auto finish_Submit = std::chrono::steady_clock::now();
+        submit_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_Submit - start_Submit);
+
+        if (readbackBuffer) {
+            readbackData_ = ReadBufferBlocking(ctx_.instance, readbackBuffer.Get(), readbackBytes_);
+        }
+        const auto finish_Readback = std::chrono::steady_clock::now();
+        readback_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_Readback - finish_Submit);
+        retained_.clear();
+    }
+
+    template <typename T>
+    std::vector<T> ReadbackAs(std::size_t handle) const {
+        const Readback& readback = readbacks_.at(handle);
+        std::vector<T> values(readback.size / sizeof(T));
+        if (!values.empty()) {
+            std::memcpy(values.data(), readbackData_.data() + readback.offset, values.size() * sizeof(T));
+        }
+        return values;
+    }
+
+    // profiling
+    std::chrono::milliseconds submit_time{0};
+    std::chrono::milliseconds readback_time{0};
+
+private:
+    struct Readback {
+        wgpu::Buffer source;
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+    };
+
+    GpuContext& ctx_;
+    wgpu::CommandEncoder encoder_;
+    std::vector<PooledBuffer> retained_;
+    std::vector<PooledBuffer> kept_;
+    std::vector<Readback> readbacks_;
+    std::uint64_t readbackBytes_ = 0;
+    std::vector<std::uint8_t> readbackData_;
+};
+
+// Acquires a buffer-backed image whose buffer lives until the frame's submit completes.
+GpuImage AcquireGpuImage(
+    GpuContext& ctx,
+    GpuFrame& frame,
     std::uint32_t width,
     std::uint32_t height,
+    GpuPixelFormat format = GpuPixelFormat::Rgba32Float) {
+    GpuImage image;
+    image.width = width;
+    image.height = height;
+    image.format = format;
+    image.buffer = frame.Retain(ctx.bufferPool.Acquire(
+        wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::CopySrc,
+        image.byteSize()));
+    return image;
+}
+
+// Binds the pixels of a buffer-backed image.
+BindingResource BufferBinding(const GpuImage& image) {
+    return {.buffer = image.buffer, .size = image.byteSize(), .offset = image.bufferOffset};
+}
+
+// One level of a dssim_q buffer handed to EncodeReduceLevels.
+struct ReduceLevel {
+    // First element of the level in the buffer.
+    std::uint32_t offset = 0;
+    std::uint32_t len = 0;
+    std::size_t scaleLevel = 0;
+};
+
+// Records the ssim_reduce.wgsl passes for every level of dssimQ in one set of dispatches
+// (z = level) and returns the buffer holding one LevelStatsData per level, in order.
+// reduce is ctx.reduce or ctx.subgroupReduce; both produce identical sums, whatever
+// their tuning. timestampWrites, if given, brackets the reduce pass (--autotune). With
+// thresholds (one per level) only the partition passes run, around those thresholds
+// instead of the ones sum_final derives; the returned sums are then zero.
+PooledBuffer EncodeReduceLevels(
+    GpuContext& ctx,
+    GpuFrame& frame,
+    const ReducePipelines& reduce,
+    const wgpu::Buffer& dssimQ,
+    std::uint64_t dssimQBytes,
+    const std::vector<ReduceLevel>& levels,
+    const wgpu::PassTimestampWrites* timestampWrites = nullptr,
+    const std::vector<std::uint32_t>& thresholds = {}) {
+    if (levels.empty() || levels.size() > kDefaultScaleWeights.size()) {
+        throw std::runtime_error("unsupported reduce level count");
+    }
+    if (!thresholds.empty() && thresholds.size() != levels.size()) {
+        throw std::runtime_error("reduce thresholds do not match its levels");
+    }
+    struct LevelParamsData {
+        std::uint32_t offset;
+        std::uint32_t len;
+        std::uint32_t numGroups;
+        float exponent;
+    };
+    struct ReduceParamsData {
+        std::uint32_t qscale;
+        std::uint32_t pad0;
+        std::uint32_t pad1;
+        std::uint32_t pad2;
+        // MAX_LEVELS in ssim_reduce.wgsl.
+        std::array<LevelParamsData, kDefaultScaleWeights.size()> level;
+    };
+    ReduceParamsData paramsData = {.qscale = kStage0QScale, .pad0 = 0, .pad1 = 0, .pad2 = 0, .level = {}};
+    std::uint32_t maxGroups = 0;
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+        const ReduceLevel& level = levels[i];
+        const std::uint32_t groups = std::min<std::uint32_t>(
+            reduce.tuning.maxGroups, (level.len + reduce.tuning.workgroupSize - 1u) / reduce.tuning.workgroupSize);
+        paramsData.level[i] = {
+            .offset = level.offset,
+            .len = level.len,
+            .numGroups = groups,
+            .exponent = static_cast<float>(std::pow(0.5, static_cast<double>(level.scaleLevel))),
+        };
+        maxGroups = std::max(maxGroups, groups);
+    }
+    const std::uint32_t levelCount = static_cast<std::uint32_t>(levels.size());
+    // Each level owns MAX_GROUPS partial slots of vec4<u32>.
+    const std::size_t partialsBytes =
+        static_cast<std::size_t>(levelCount) * reduce.tuning.maxGroups * sizeof(std::uint32_t) * 4u;
+    const std::size_t levelStatsBytes = static_cast<std::size_t>(levelCount) * sizeof(LevelStatsData);
+
+    const PooledBuffer partialsPooled = ctx.bufferPool.Acquire(wgpu::BufferUsage::Storage, partialsBytes);
+    PooledBuffer levelStatsPooled = ctx.bufferPool.Acquire(
+        wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst, levelStatsBytes);
+    if (!thresholds.empty()) {
+        std::vector<LevelStatsData> initialStats(levels.size());
+        for (std::size_t i = 0; i < levels.size(); ++i) {
+            initialStats[i].threshold = thresholds[i];
+        }
+        ctx.queue.WriteBuffer(levelStatsPooled.Get(), 0, initialStats.data(), levelStatsBytes);
+    }
+    const wgpu::Buffer paramsBuffer = frame.Upload(wgpu::BufferUsage::Uniform, &paramsData, sizeof(ReduceParamsData));
+    const wgpu::BindGroup bindGroup = CreateBindGroup(
+        ctx.device, ctx.reduceBgl,
+        {{dssimQ, dssimQBytes},
+         {partialsPooled.Get(), partialsBytes},
+         {levelStatsPooled.Get(), levelStatsBytes},
+         {paramsBuffer, sizeof(ReduceParamsData)}},
+        "reduce");
+
+    // Sum, threshold, then partition around the threshold; see ssim_reduce.wgsl.
+    wgpu::ComputePassDescriptor passDesc = {};
+    passDesc.timestampWrites = timestampWrites;
+    wgpu::ComputePassEncoder pass = frame.encoder().BeginComputePass(&passDesc);
+    pass.SetBindGroup(0, bindGroup);
+    if (thresholds.empty()) {
+        pass.SetPipeline(reduce.sumPartials);
+        pass.DispatchWorkgroups(maxGroups, 1, levelCount);
+        pass.SetPipeline(reduce.sumFinal);
+        pass.DispatchWorkgroups(1, 1, levelCount);
+    }
+    pass.SetPipeline(reduce.partitionPartials);
+    pass.DispatchWorkgroups(maxGroups, 1, levelCount);
+    pass.SetPipeline(reduce.partitionFinal);
+    pass.DispatchWorkgroups(1, 1, levelCount);
+    pass.End();
+    return levelStatsPooled;
+}
+
+// Handles into a GpuFrame's readback buffer for one encoded stage0 level.
+struct Stage0Pending {
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::size_t scaleLevel = 0;
+    std::size_t levelStatsReadback = 0;
+    // Entry of the LevelStats readback that belongs to this level (batched levels share one).
+    std::size_t levelStatsIndex = 0;
+    // The level's dssim map (batched levels share one buffer), kept by the frame for
+    // ResolveLevelStats.
+    wgpu::Buffer dssimQ;
+    std::uint64_t dssimQBytes = 0;
+    ReduceLevel reduceLevel;
+    bool hasDssimQ = false;
+    std::size_t dssimQReadback = 0;
+    bool hasIntermediateStats = false;
+    std::array<std::size_t, 5> statsReadbacks = {};
+    // profiling
+    std::chrono::milliseconds createBuffers_time{0};
+    std::chrono::milliseconds writeInputBuffers_time{0};
+    std::chrono::milliseconds createBindGroups_time{0};
+    std::chrono::milliseconds dispatchAndSubmit_time{0};
+};
+
+Stage0Pending EncodeStage0Compute(
+    GpuContext& ctx,
+    GpuFrame& frame,
+    const ReducePipelines& reduce,
+    const GpuImage& input1,
+    const GpuImage& input2,
     std::size_t scaleLevel,
+    bool readDssimMap,
     bool readIntermediateStats,
-    const std::string& preprocessShaderSource,
-    const std::string& stage0ShaderSource) {
-    if (input1.size() != input2.size()) {
+    bool fused,
+    const wgpu::PassTimestampWrites* stageTimestampWrites = nullptr) {
+    const wgpu::Device& device = ctx.device;
+    if (fused && readIntermediateStats) {
+        throw std::runtime_error("the fused stage0 shader does not write the debug planes");
+    }
+    if (input1.width != input2.width || input1.height != input2.height || input1.format != input2.format ||
+        input1.textureBacked != input2.textureBacked) {
         throw std::runtime_error("input buffer size mismatch");
     }
-    if (input1.empty()) {
-        return {};
+    if (input1.pixelCount() == 0) {
+        throw std::runtime_error("stage0 input is empty");
     }
 
-    const std::size_t elemCount = input1.size();
+    const std::uint32_t width = input1.width;
+    const std::uint32_t height = input1.height;
+    const std::size_t elemCount = input1.pixelCount();
     if (elemCount > std::numeric_limits<std::uint32_t>::max()) {
         throw std::runtime_error("input too large for u32 dispatch length");
     }
-    const std::size_t expectedCount = static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
-    if (expectedCount != elemCount) {
-        throw std::runtime_error("pixel count mismatch between input buffers and dimensions");
-    }
 
-    const std::size_t rgbaBytes = elemCount * sizeof(LinearRgba);
-    const std::size_t labBytes = elemCount * sizeof(float) * 4u;
+    // Both images' planar L, a, b channels in one buffer, see lab_preprocess.wgsl.
+    const std::size_t labElemBytes = ctx.labF16 ? sizeof(std::uint16_t) : sizeof(float);
+    const std::size_t labBytes = elemCount * labElemBytes * 6u;
     const std::size_t u32Bytes = elemCount * sizeof(std::uint32_t);
     const std::size_t f32Bytes = elemCount * sizeof(float);
 
-    ScaleOutputs outputs;
+    Stage0Pending pending;
+    pending.width = width;
+    pending.height = height;
+    pending.scaleLevel = scaleLevel;
+    pending.hasDssimQ = readDssimMap;
+    pending.hasIntermediateStats = readIntermediateStats;
 
     struct ParamsData {
         std::uint32_t len;
@@ -662,545 +1493,598 @@ ScaleOutputs RunStage0Compute(
     };
     const auto start_CreateBuffers = std::chrono::steady_clock::now();
 
-    wgpu::BufferDescriptor rgbaStorageDesc = {};
-    rgbaStorageDesc.size = static_cast<std::uint64_t>(rgbaBytes);
-    rgbaStorageDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
-    rgbaStorageDesc.mappedAtCreation = false;
-
-    wgpu::Buffer input1Buffer = device.CreateBuffer(&rgbaStorageDesc);
-    wgpu::Buffer input2Buffer = device.CreateBuffer(&rgbaStorageDesc);
-    wgpu::BufferDescriptor labStorageDesc = {};
-    labStorageDesc.size = static_cast<std::uint64_t>(labBytes);
-    labStorageDesc.usage = wgpu::BufferUsage::Storage;
-    labStorageDesc.mappedAtCreation = false;
-    wgpu::Buffer lab1Buffer = device.CreateBuffer(&labStorageDesc);
-    wgpu::Buffer lab2Buffer = device.CreateBuffer(&labStorageDesc);
-
-    wgpu::BufferDescriptor u32StorageDesc = {};
-    u32StorageDesc.size = static_cast<std::uint64_t>(u32Bytes);
-    u32StorageDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc;
-    u32StorageDesc.mappedAtCreation = false;
-
-    wgpu::BufferDescriptor f32StorageDesc = {};
-    f32StorageDesc.size = static_cast<std::uint64_t>(f32Bytes);
-    f32StorageDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc;
-    f32StorageDesc.mappedAtCreation = false;
-
-    wgpu::Buffer outDssimQBuffer = device.CreateBuffer(&u32StorageDesc);
-    wgpu::Buffer outMu1Buffer = device.CreateBuffer(&f32StorageDesc);
-    wgpu::Buffer outMu2Buffer = device.CreateBuffer(&f32StorageDesc);
-    wgpu::Buffer outVar1Buffer = device.CreateBuffer(&f32StorageDesc);
-    wgpu::Buffer outVar2Buffer = device.CreateBuffer(&f32StorageDesc);
-    wgpu::Buffer outCov12Buffer = device.CreateBuffer(&f32StorageDesc);
-    if (!input1Buffer || !input2Buffer || !lab1Buffer || !lab2Buffer || !outDssimQBuffer || !outMu1Buffer ||
-        !outMu2Buffer || !outVar1Buffer || !outVar2Buffer || !outCov12Buffer) {
-        throw std::runtime_error("failed to create stage0 buffers");
-    }
-
-    wgpu::BufferDescriptor readbackU32Desc = {};
-    readbackU32Desc.size = static_cast<std::uint64_t>(u32Bytes);
-    readbackU32Desc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead;
-    readbackU32Desc.mappedAtCreation = false;
-    wgpu::Buffer readbackDssimQBuffer = device.CreateBuffer(&readbackU32Desc);
-    if (!readbackDssimQBuffer) {
-        throw std::runtime_error("failed to create stage0 dssim readback buffer");
-    }
-
-    wgpu::Buffer readbackMu1Buffer;
-    wgpu::Buffer readbackMu2Buffer;
-    wgpu::Buffer readbackVar1Buffer;
-    wgpu::Buffer readbackVar2Buffer;
-    wgpu::Buffer readbackCov12Buffer;
+    GpuBufferPool& pool = ctx.bufferPool;
+    const wgpu::BufferUsage storageOutUsage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc;
+
+    // The fused shader keeps Lab in workgroup memory and needs neither Lab buffer.
+    PooledBuffer labPooled;
+    PooledBuffer labRawPooled;
+    if (!fused) {
+        labPooled = pool.Acquire(wgpu::BufferUsage::Storage, labBytes);
+        labRawPooled = pool.Acquire(wgpu::BufferUsage::Storage, labBytes);
+    }
+    const wgpu::Buffer outDssimQBuffer = frame.Keep(pool.Acquire(storageOutUsage, u32Bytes));
+    // mu1, mu2, var1, var2, cov12; only allocated when the debug planes are requested.
+    std::array<PooledBuffer, 5> statsPooled;
     if (readIntermediateStats) {
-        wgpu::BufferDescriptor readbackF32Desc = {};
-        readbackF32Desc.size = static_cast<std::uint64_t>(f32Bytes);
-        readbackF32Desc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead;
-        readbackF32Desc.mappedAtCreation = false;
-        readbackMu1Buffer = device.CreateBuffer(&readbackF32Desc);
-        readbackMu2Buffer = device.CreateBuffer(&readbackF32Desc);
-        readbackVar1Buffer = device.CreateBuffer(&readbackF32Desc);
-        readbackVar2Buffer = device.CreateBuffer(&readbackF32Desc);
-        readbackCov12Buffer = device.CreateBuffer(&readbackF32Desc);
-        if (!readbackMu1Buffer || !readbackMu2Buffer || !readbackVar1Buffer || !readbackVar2Buffer ||
-            !readbackCov12Buffer) {
-            throw std::runtime_error("failed to create stage0 stats readback buffers");
-        }
-    }
-
-    wgpu::BufferDescriptor paramsDesc = {};
-    paramsDesc.size = static_cast<std::uint64_t>(sizeof(ParamsData));
-    paramsDesc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
-    paramsDesc.mappedAtCreation = false;
-    wgpu::Buffer paramsBuffer = device.CreateBuffer(&paramsDesc);
-    if (!paramsBuffer) {
-        throw std::runtime_error("failed to create stage0 params buffer");
+        for (PooledBuffer& plane : statsPooled) {
+            plane = pool.Acquire(storageOutUsage, f32Bytes);
+        }
     }
+
     const auto finish_CreateBuffers = std::chrono::steady_clock::now();
-    outputs.createBuffers_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateBuffers - start_CreateBuffers);
+    pending.createBuffers_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateBuffers - start_CreateBuffers);
 
-    wgpu::Queue queue = device.GetQueue();
     const auto start_WriteInputBuffers = std::chrono::steady_clock::now();
-    queue.WriteBuffer(input1Buffer, 0, input1.data(), rgbaBytes);
-    queue.WriteBuffer(input2Buffer, 0, input2.data(), rgbaBytes);
-    queue.WriteBuffer(paramsBuffer, 0, &paramsData, sizeof(ParamsData));
+    const wgpu::Buffer& paramsBuffer = frame.Upload(wgpu::BufferUsage::Uniform, &paramsData, sizeof(ParamsData));
     const auto finish_WriteInputBuffers = std::chrono::steady_clock::now();
-    outputs.writeInputBuffers_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_WriteInputBuffers - start_WriteInputBuffers);
+    pending.writeInputBuffers_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_WriteInputBuffers - start_WriteInputBuffers);
 
-    const auto start_CreateShaderModule = std::chrono::steady_clock::now();
-    wgpu::ShaderModule preprocessShader = CreateShaderModule(device, preprocessShaderSource);
-    wgpu::ShaderModule stage0Shader = CreateShaderModule(device, stage0ShaderSource);
-    const auto finish_CreateShaderModule = std::chrono::steady_clock::now();
-    outputs.createShaderModule_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateShaderModule - start_CreateShaderModule);
+    const auto start_CreateBindGroups = std::chrono::steady_clock::now();
 
-    if (!preprocessShader || !stage0Shader) {
-        throw std::runtime_error("failed to create stage0/preprocess shader module");
+    const std::uint64_t paramsSize = sizeof(ParamsData);
+    const bool rgba8 = input1.format == GpuPixelFormat::Rgba8;
+    // Fused: one dispatch over both inputs. Otherwise convert -> blur -> stage0 through
+    // the two Lab buffers.
+    wgpu::ComputePipeline fusedPipeline;
+    wgpu::BindGroup fusedBg;
+    wgpu::ComputePipeline convertPipeline;
+    wgpu::BindGroup convertBg;
+    wgpu::BindGroup blurBg;
+    wgpu::BindGroup bindGroup;
+    if (fused) {
+        fusedPipeline = input1.textureBacked
+            ? (rgba8 ? ctx.fusedTextureSrgb8Pipeline : ctx.fusedTexturePipeline)
+            : (rgba8 ? ctx.fusedRgba8Pipeline : ctx.fusedPipeline);
+        fusedBg = input1.textureBacked
+            ? CreateBindGroup(
+                  device, ctx.preprocessTextureBgl,
+                  {{.textureView = input1.decodeView},
+                   {outDssimQBuffer, u32Bytes},
+                   {paramsBuffer, paramsSize},
+                   {.textureView = input2.decodeView}},
+                  "fused texture")
+            : CreateBindGroup(
+                  device, ctx.preprocessConvertBgl,
+                  {BufferBinding(input1),
+                   {outDssimQBuffer, u32Bytes},
+                   {paramsBuffer, paramsSize},
+                   BufferBinding(input2),
+                   {ctx.srgbLut, kSrgbLutBytes}},
+                  "fused");
+    } else {
+        const wgpu::Buffer& labBuffer = labPooled.Get();
+        const wgpu::Buffer& labRawBuffer = labRawPooled.Get();
+        convertPipeline = input1.textureBacked
+            ? (rgba8 ? ctx.preprocessConvertTextureSrgb8Pipeline : ctx.preprocessConvertTexturePipeline)
+            : (rgba8 ? ctx.preprocessConvertRgba8Pipeline : ctx.preprocessConvertPipeline);
+        convertBg = input1.textureBacked
+            ? CreateBindGroup(
+                  device, ctx.preprocessTextureBgl,
+                  {{.textureView = input1.decodeView},
+                   {labRawBuffer, labBytes},
+                   {paramsBuffer, paramsSize},
+                   {.textureView = input2.decodeView}},
+                  "preprocess convert_texture")
+            : CreateBindGroup(
+                  device, ctx.preprocessConvertBgl,
+                  {BufferBinding(input1),
+                   {labRawBuffer, labBytes},
+                   {paramsBuffer, paramsSize},
+                   BufferBinding(input2),
+                   {ctx.srgbLut, kSrgbLutBytes}},
+                  "preprocess convert");
+        blurBg = CreateBindGroup(
+            device, ctx.preprocessBgl,
+            {{labRawBuffer, labBytes}, {labBuffer, labBytes}, {paramsBuffer, paramsSize}}, "preprocess blur");
+        std::vector<BindingResource> stage0Bindings = {
+            {labBuffer, labBytes},
+            {outDssimQBuffer, u32Bytes},
+            {paramsBuffer, paramsSize},
+        };
+        if (readIntermediateStats) {
+            for (const PooledBuffer& plane : statsPooled) {
+                stage0Bindings.push_back({plane.Get(), f32Bytes});
+            }
+        }
+        bindGroup = CreateBindGroup(
+            device, readIntermediateStats ? ctx.stage0DebugBgl : ctx.stage0Bgl, stage0Bindings, "stage0");
     }
-    const auto start_CreatePipelineLayouts = std::chrono::steady_clock::now();
+    const auto finish_CreateBindGroups = std::chrono::steady_clock::now();
+    pending.createBindGroups_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateBindGroups - start_CreateBindGroups);
+    const auto start_DispatchAndSubmit = std::chrono::steady_clock::now();
 
-    wgpu::BindGroupLayoutEntry preprocessLayoutEntries[3] = {};
-    preprocessLayoutEntries[0].binding = 0;
-    preprocessLayoutEntries[0].visibility = wgpu::ShaderStage::Compute;
-    preprocessLayoutEntries[0].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
-    preprocessLayoutEntries[1].binding = 1;
-    preprocessLayoutEntries[1].visibility = wgpu::ShaderStage::Compute;
-    preprocessLayoutEntries[1].buffer.type = wgpu::BufferBindingType::Storage;
-    preprocessLayoutEntries[2].binding = 2;
-    preprocessLayoutEntries[2].visibility = wgpu::ShaderStage::Compute;
-    preprocessLayoutEntries[2].buffer.type = wgpu::BufferBindingType::Uniform;
-    preprocessLayoutEntries[2].buffer.minBindingSize = sizeof(ParamsData);
-    wgpu::BindGroupLayoutDescriptor preprocessBglDesc = {};
-    preprocessBglDesc.entryCount = 3;
-    preprocessBglDesc.entries = preprocessLayoutEntries;
-    wgpu::BindGroupLayout preprocessBgl = device.CreateBindGroupLayout(&preprocessBglDesc);
-    if (!preprocessBgl) {
-        throw std::runtime_error("failed to create preprocess bind group layout");
-    }
-
-    wgpu::PipelineLayoutDescriptor preprocessPlDesc = {};
-    preprocessPlDesc.bindGroupLayoutCount = 1;
-    preprocessPlDesc.bindGroupLayouts = &preprocessBgl;
-    wgpu::PipelineLayout preprocessPl = device.CreatePipelineLayout(&preprocessPlDesc);
-    if (!preprocessPl) {
-        throw std::runtime_error("failed to create preprocess pipeline layout");
-    }
-
-    wgpu::ComputePipelineDescriptor preprocessPipeDesc = {};
-    preprocessPipeDesc.layout = preprocessPl;
-    preprocessPipeDesc.compute.module = preprocessShader;
-    preprocessPipeDesc.compute.entryPoint = "main";
-    auto start_createPSO = std::chrono::high_resolution_clock::now();
-    wgpu::ComputePipeline preprocessPipe = device.CreateComputePipeline(&preprocessPipeDesc);
-    auto finish_createPSO = std::chrono::high_resolution_clock::now();
-    outputs.createPSO_time = duration_cast<milliseconds>(finish_createPSO - start_createPSO);
-    if (!preprocessPipe) {
-        throw std::runtime_error("failed to create preprocess pipeline");
-    }
-    const auto start_CreateBindGroups = std::chrono::steady_clock::now();
+    const wgpu::CommandEncoder& encoder = frame.encoder();
+    const TileShape& labTile = ctx.stageTuning.lab;
+    const TileShape& fusedTile = ctx.stageTuning.fused;
+    const std::uint32_t tilesX = (width + labTile.x - 1u) / labTile.x;
+    const std::uint32_t tilesY = (height + labTile.y - 1u) / labTile.y;
+    if (fused) {
+        wgpu::ComputePassDescriptor passDesc = {};
+        passDesc.timestampWrites = stageTimestampWrites;
+        wgpu::ComputePassEncoder pass = encoder.BeginComputePass(&passDesc);
+        pass.SetPipeline(fusedPipeline);
+        pass.SetBindGroup(0, fusedBg);
+        pass.DispatchWorkgroups(
+            (width + fusedTile.x - 1u) / fusedTile.x, (height + fusedTile.y - 1u) / fusedTile.y, 1);
+        pass.End();
+    } else {
+        // The stage timestamps span both passes: the first writes the beginning, the
+        // second the end.
+        wgpu::PassTimestampWrites firstWrites = {};
+        wgpu::PassTimestampWrites lastWrites = {};
+        if (stageTimestampWrites != nullptr) {
+            firstWrites.querySet = stageTimestampWrites->querySet;
+            firstWrites.beginningOfPassWriteIndex = stageTimestampWrites->beginningOfPassWriteIndex;
+            firstWrites.endOfPassWriteIndex = wgpu::kQuerySetIndexUndefined;
+            lastWrites.querySet = stageTimestampWrites->querySet;
+            lastWrites.beginningOfPassWriteIndex = wgpu::kQuerySetIndexUndefined;
+            lastWrites.endOfPassWriteIndex = stageTimestampWrites->endOfPassWriteIndex;
+        }
+        wgpu::ComputePassDescriptor passDesc = {};
+        passDesc.timestampWrites = (stageTimestampWrites != nullptr) ? &firstWrites : nullptr;
+        wgpu::ComputePassEncoder pass = encoder.BeginComputePass(&passDesc);
+        // Convert both images to Lab once into labRaw, then blur a/b into lab; z selects
+        // the image.
+        pass.SetPipeline(convertPipeline);
+        pass.SetBindGroup(0, convertBg);
+        pass.DispatchWorkgroups(tilesX, tilesY, 2);
+        pass.SetPipeline(ctx.preprocessBlurPipeline);
+        pass.SetBindGroup(0, blurBg);
+        pass.DispatchWorkgroups(tilesX, tilesY, 2);
+        pass.End();
 
-    wgpu::BindGroupEntry preprocessBg1Entries[3] = {};
-    preprocessBg1Entries[0].binding = 0;
-    preprocessBg1Entries[0].buffer = input1Buffer;
-    preprocessBg1Entries[0].size = static_cast<std::uint64_t>(rgbaBytes);
-    preprocessBg1Entries[1].binding = 1;
-    preprocessBg1Entries[1].buffer = lab1Buffer;
-    preprocessBg1Entries[1].size = static_cast<std::uint64_t>(labBytes);
-    preprocessBg1Entries[2].binding = 2;
-    preprocessBg1Entries[2].buffer = paramsBuffer;
-    preprocessBg1Entries[2].size = static_cast<std::uint64_t>(sizeof(ParamsData));
-
-    wgpu::BindGroupEntry preprocessBg2Entries[3] = {};
-    preprocessBg2Entries[0].binding = 0;
-    preprocessBg2Entries[0].buffer = input2Buffer;
-    preprocessBg2Entries[0].size = static_cast<std::uint64_t>(rgbaBytes);
-    preprocessBg2Entries[1].binding = 1;
-    preprocessBg2Entries[1].buffer = lab2Buffer;
-    preprocessBg2Entries[1].size = static_cast<std::uint64_t>(labBytes);
-    preprocessBg2Entries[2].binding = 2;
-    preprocessBg2Entries[2].buffer = paramsBuffer;
-    preprocessBg2Entries[2].size = static_cast<std::uint64_t>(sizeof(ParamsData));
-
-    wgpu::BindGroupDescriptor preprocessBg1Desc = {};
-    preprocessBg1Desc.layout = preprocessBgl;
-    preprocessBg1Desc.entryCount = 3;
-    preprocessBg1Desc.entries = preprocessBg1Entries;
-    wgpu::BindGroup preprocessBg1 = device.CreateBindGroup(&preprocessBg1Desc);
-    wgpu::BindGroupDescriptor preprocessBg2Desc = {};
-    preprocessBg2Desc.layout = preprocessBgl;
-    preprocessBg2Desc.entryCount = 3;
-    preprocessBg2Desc.entries = preprocessBg2Entries;
-    wgpu::BindGroup preprocessBg2 = device.CreateBindGroup(&preprocessBg2Desc);
-    if (!preprocessBg1 || !preprocessBg2) {
-        throw std::runtime_error("failed to create preprocess bind groups");
-    }
-
-    wgpu::BindGroupLayoutEntry layoutEntries[9] = {};
-    for (std::uint32_t i = 0; i < 8; ++i) {
-        layoutEntries[i].binding = i;
-        layoutEntries[i].visibility = wgpu::ShaderStage::Compute;
-        if (i <= 1) {
-            layoutEntries[i].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
-        } else {
-            layoutEntries[i].buffer.type = wgpu::BufferBindingType::Storage;
+        passDesc.timestampWrites = (stageTimestampWrites != nullptr) ? &lastWrites : nullptr;
+        wgpu::ComputePassEncoder stage0Pass = encoder.BeginComputePass(&passDesc);
+        stage0Pass.SetPipeline(readIntermediateStats ? ctx.stage0DebugPipeline : ctx.stage0Pipeline);
+        stage0Pass.SetBindGroup(0, bindGroup);
+        stage0Pass.DispatchWorkgroups(tilesX, tilesY, 1);
+        stage0Pass.End();
+    }
+    const ReduceLevel reduceLevel = {.offset = 0, .len = static_cast<std::uint32_t>(elemCount), .scaleLevel = scaleLevel};
+    PooledBuffer levelStatsPooled = EncodeReduceLevels(ctx, frame, reduce, outDssimQBuffer, u32Bytes, {reduceLevel});
+    pending.levelStatsReadback = frame.ScheduleReadback(std::move(levelStatsPooled), sizeof(LevelStatsData));
+    pending.dssimQ = outDssimQBuffer;
+    pending.dssimQBytes = u32Bytes;
+    pending.reduceLevel = reduceLevel;
+    if (readDssimMap) {
+        pending.dssimQReadback = frame.ScheduleReadback(outDssimQBuffer, u32Bytes);
+    }
+    if (readIntermediateStats) {
+        for (std::size_t plane = 0; plane < statsPooled.size(); ++plane) {
+            pending.statsReadbacks[plane] = frame.ScheduleReadback(std::move(statsPooled[plane]), f32Bytes);
         }
-        layoutEntries[i].buffer.minBindingSize = 0;
     }
-    layoutEntries[8].binding = 8;
-    layoutEntries[8].visibility = wgpu::ShaderStage::Compute;
-    layoutEntries[8].buffer.type = wgpu::BufferBindingType::Uniform;
-    layoutEntries[8].buffer.minBindingSize = sizeof(ParamsData);
+    const auto finish_DispatchAndSubmit = std::chrono::steady_clock::now();
+    pending.dispatchAndSubmit_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_DispatchAndSubmit - start_DispatchAndSubmit);
+    return pending;
+}
 
-    wgpu::BindGroupLayoutDescriptor bglDesc = {};
-    bglDesc.entryCount = 9;
-    bglDesc.entries = layoutEntries;
-    wgpu::BindGroupLayout bindGroupLayout = device.CreateBindGroupLayout(&bglDesc);
-    if (!bindGroupLayout) {
-        throw std::runtime_error("failed to create stage0 bind group layout");
-    }
+// Workgroups of ssim_fused.wgsl with output tile `tile` that cover one width x height level.
+std::uint64_t FusedTileCount(std::uint32_t width, std::uint32_t height, const TileShape& tile) {
+    return static_cast<std::uint64_t>((width + tile.x - 1u) / tile.x) * ((height + tile.y - 1u) / tile.y);
+}
 
-    wgpu::PipelineLayoutDescriptor plDesc = {};
-    plDesc.bindGroupLayoutCount = 1;
-    plDesc.bindGroupLayouts = &bindGroupLayout;
-    wgpu::PipelineLayout pipelineLayout = device.CreatePipelineLayout(&plDesc);
-    if (!pipelineLayout) {
-        throw std::runtime_error("failed to create stage0 pipeline layout");
+// Records the fused stage0 of pyramid levels firstLevel..lastLevel (scale levels, >= 1)
+// as one main_batched dispatch, with their dssim maps packed into one buffer and a level
+// table mapping each workgroup to its level, followed by one reduce over all of them. The
+// returned entries, one per level, share a LevelStats readback at consecutive indices.
+std::vector<Stage0Pending> EncodeStage0Batch(
+    GpuContext& ctx,
+    GpuFrame& frame,
+    const ReducePipelines& reduce,
+    const DownsampleOutputs& pyramid,
+    std::size_t firstLevel,
+    std::size_t lastLevel) {
+    if (firstLevel == 0 || firstLevel > lastLevel || lastLevel > pyramid.levels.size() ||
+        lastLevel - firstLevel + 1 > kPyramidMaxLevels) {
+        throw std::runtime_error("invalid stage0 batch level range");
+    }
+    const bool textureBacked = pyramid.levels[firstLevel - 1][0].textureBacked;
+
+    struct BatchLevelData {
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t inOffset;
+        std::uint32_t outOffset;
+        std::uint32_t firstTile;
+        std::uint32_t tilesX;
+        std::uint32_t mip;
+        std::uint32_t pad0;
+    };
+    struct BatchParamsData {
+        std::uint32_t count;
+        std::uint32_t qscale;
+        std::uint32_t pad0;
+        std::uint32_t pad1;
+        // MAX_BATCH_LEVELS in ssim_fused.wgsl.
+        std::array<BatchLevelData, kPyramidMaxLevels> level;
+    };
+    BatchParamsData paramsData = {
+        .count = static_cast<std::uint32_t>(lastLevel - firstLevel + 1),
+        .qscale = kStage0QScale,
+        .pad0 = 0,
+        .pad1 = 0,
+        .level = {},
+    };
+    std::vector<Stage0Pending> pendings;
+    std::vector<ReduceLevel> reduceLevels;
+    std::uint64_t outElems = 0;
+    std::uint64_t tiles = 0;
+    for (std::size_t level = firstLevel; level <= lastLevel; ++level) {
+        const GpuImage& image = pyramid.levels[level - 1][0];
+        paramsData.level[level - firstLevel] = {
+            .width = image.width,
+            .height = image.height,
+            .inOffset = static_cast<std::uint32_t>(image.bufferOffset / sizeof(LinearRgba)),
+            .outOffset = static_cast<std::uint32_t>(outElems),
+            .firstTile = static_cast<std::uint32_t>(tiles),
+            .tilesX = (image.width + ctx.stageTuning.fused.x - 1u) / ctx.stageTuning.fused.x,
+            .mip = static_cast<std::uint32_t>(level - 1),
+            .pad0 = 0,
+        };
+        reduceLevels.push_back({
+            .offset = static_cast<std::uint32_t>(outElems),
+            .len = static_cast<std::uint32_t>(image.pixelCount()),
+            .scaleLevel = level,
+        });
+        Stage0Pending pending;
+        pending.width = image.width;
+        pending.height = image.height;
+        pending.scaleLevel = level;
+        pending.levelStatsIndex = level - firstLevel;
+        pendings.push_back(pending);
+        outElems += image.pixelCount();
+        tiles += FusedTileCount(image.width, image.height, ctx.stageTuning.fused);
     }
-    const auto finish_CreatePipelineLayouts = std::chrono::steady_clock::now();
-    outputs.createPipelineLayouts_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreatePipelineLayouts - start_CreatePipelineLayouts);
+    if (tiles > kMaxWorkgroupsPerDimension || outElems > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error("stage0 batch too large for one dispatch");
+    }
+    Stage0Pending& first = pendings.front();
 
-    wgpu::ComputePipelineDescriptor pipelineDesc = {};
-    pipelineDesc.layout = pipelineLayout;
-    pipelineDesc.compute.module = stage0Shader;
-    pipelineDesc.compute.entryPoint = "main";
-    start_createPSO = std::chrono::high_resolution_clock::now();
-    wgpu::ComputePipeline pipeline = device.CreateComputePipeline(&pipelineDesc);
-    finish_createPSO = std::chrono::high_resolution_clock::now();
-    outputs.createPSO_time += duration_cast<milliseconds>(finish_createPSO - start_createPSO);
-    if (!pipeline) {
-        throw std::runtime_error("failed to create stage0 compute pipeline");
-    }
-
-    wgpu::BindGroupEntry bgEntries[9] = {};
-    bgEntries[0].binding = 0;
-    bgEntries[0].buffer = lab1Buffer;
-    bgEntries[0].offset = 0;
-    bgEntries[0].size = static_cast<std::uint64_t>(labBytes);
-
-    bgEntries[1].binding = 1;
-    bgEntries[1].buffer = lab2Buffer;
-    bgEntries[1].offset = 0;
-    bgEntries[1].size = static_cast<std::uint64_t>(labBytes);
-
-    bgEntries[2].binding = 2;
-    bgEntries[2].buffer = outDssimQBuffer;
-    bgEntries[2].offset = 0;
-    bgEntries[2].size = static_cast<std::uint64_t>(u32Bytes);
-
-    bgEntries[3].binding = 3;
-    bgEntries[3].buffer = outMu1Buffer;
-    bgEntries[3].offset = 0;
-    bgEntries[3].size = static_cast<std::uint64_t>(f32Bytes);
-
-    bgEntries[4].binding = 4;
-    bgEntries[4].buffer = outMu2Buffer;
-    bgEntries[4].offset = 0;
-    bgEntries[4].size = static_cast<std::uint64_t>(f32Bytes);
-
-    bgEntries[5].binding = 5;
-    bgEntries[5].buffer = outVar1Buffer;
-    bgEntries[5].offset = 0;
-    bgEntries[5].size = static_cast<std::uint64_t>(f32Bytes);
-
-    bgEntries[6].binding = 6;
-    bgEntries[6].buffer = outVar2Buffer;
-    bgEntries[6].offset = 0;
-    bgEntries[6].size = static_cast<std::uint64_t>(f32Bytes);
-
-    bgEntries[7].binding = 7;
-    bgEntries[7].buffer = outCov12Buffer;
-    bgEntries[7].offset = 0;
-    bgEntries[7].size = static_cast<std::uint64_t>(f32Bytes);
-
-    bgEntries[8].binding = 8;
-    bgEntries[8].buffer = paramsBuffer;
-    bgEntries[8].offset = 0;
-    bgEntries[8].size = static_cast<std::uint64_t>(sizeof(ParamsData));
+    const auto start_CreateBuffers = std::chrono::steady_clock::now();
+    const std::uint64_t dssimQBytes = outElems * sizeof(std::uint32_t);
+    const wgpu::Buffer dssimQBuffer = frame.Keep(ctx.bufferPool.Acquire(wgpu::BufferUsage::Storage, dssimQBytes));
+    const auto finish_CreateBuffers = std::chrono::steady_clock::now();
+    first.createBuffers_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateBuffers - start_CreateBuffers);
 
-    wgpu::BindGroupDescriptor bgDesc = {};
-    bgDesc.layout = bindGroupLayout;
-    bgDesc.entryCount = 9;
-    bgDesc.entries = bgEntries;
-    wgpu::BindGroup bindGroup = device.CreateBindGroup(&bgDesc);
-    if (!bindGroup) {
-        throw std::runtime_error("failed to create stage0 bind group");
+    const auto start_WriteInputBuffers = std::chrono::steady_clock::now();
+    const wgpu::Buffer paramsBuffer = frame.Upload(wgpu::BufferUsage::Uniform, &paramsData, sizeof(BatchParamsData));
+    const auto finish_WriteInputBuffers = std::chrono::steady_clock::now();
+    first.writeInputBuffers_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_WriteInputBuffers - start_WriteInputBuffers);
+
+    const auto start_CreateBindGroups = std::chrono::steady_clock::now();
+    wgpu::BindGroup bindGroup;
+    if (textureBacked) {
+        // Every mip of one image's layer, so the shader can pick each level's mip.
+        std::array<wgpu::TextureView, 2> layerViews;
+        for (std::uint32_t i = 0; i < 2; ++i) {
+            wgpu::TextureViewDescriptor viewDesc = {};
+            viewDesc.dimension = wgpu::TextureViewDimension::e2D;
+            viewDesc.baseArrayLayer = i;
+            viewDesc.arrayLayerCount = 1;
+            layerViews[i] = pyramid.texture.CreateView(&viewDesc);
+        }
+        bindGroup = CreateBindGroup(
+            ctx.device, ctx.preprocessTextureBgl,
+            {{.textureView = layerViews[0]},
+             {dssimQBuffer, dssimQBytes},
+             {paramsBuffer, sizeof(BatchParamsData)},
+             {.textureView = layerViews[1]}},
+            "fused batched texture");
+    } else {
+        bindGroup = CreateBindGroup(
+            ctx.device, ctx.preprocessConvertBgl,
+            {{pyramid.buffers[0], pyramid.bufferBytes},
+             {dssimQBuffer, dssimQBytes},
+             {paramsBuffer, sizeof(BatchParamsData)},
+             {pyramid.buffers[1], pyramid.bufferBytes},
+             {ctx.srgbLut, kSrgbLutBytes}},
+            "fused batched");
     }
     const auto finish_CreateBindGroups = std::chrono::steady_clock::now();
-    outputs.createBindGroups_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateBindGroups - start_CreateBindGroups);
-    const auto start_DispatchAndSubmit = std::chrono::steady_clock::now();
+    first.createBindGroups_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateBindGroups - start_CreateBindGroups);
 
-    wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
-    {
-        wgpu::ComputePassDescriptor passDesc = {};
-        wgpu::ComputePassEncoder pass = encoder.BeginComputePass(&passDesc);
-        pass.SetPipeline(preprocessPipe);
-        pass.SetBindGroup(0, preprocessBg1);
-        const std::uint32_t workgroupCount = static_cast<std::uint32_t>((elemCount + 63) / 64);
-        pass.DispatchWorkgroups(workgroupCount, 1, 1);
-        pass.SetBindGroup(0, preprocessBg2);
-        pass.DispatchWorkgroups(workgroupCount, 1, 1);
-        pass.End();
-    }
+    const auto start_DispatchAndSubmit = std::chrono::steady_clock::now();
     {
         wgpu::ComputePassDescriptor passDesc = {};
-        wgpu::ComputePassEncoder pass = encoder.BeginComputePass(&passDesc);
-        pass.SetPipeline(pipeline);
+        wgpu::ComputePassEncoder pass = frame.encoder().BeginComputePass(&passDesc);
+        pass.SetPipeline(textureBacked ? ctx.fusedBatchedTexturePipeline : ctx.fusedBatchedPipeline);
         pass.SetBindGroup(0, bindGroup);
-        const std::uint32_t workgroupCount = static_cast<std::uint32_t>((elemCount + 63) / 64);
-        pass.DispatchWorkgroups(workgroupCount, 1, 1);
+        pass.DispatchWorkgroups(static_cast<std::uint32_t>(tiles), 1, 1);
         pass.End();
     }
-    encoder.CopyBufferToBuffer(outDssimQBuffer, 0, readbackDssimQBuffer, 0, static_cast<std::uint64_t>(u32Bytes));
-    if (readIntermediateStats) {
-        encoder.CopyBufferToBuffer(outMu1Buffer, 0, readbackMu1Buffer, 0, static_cast<std::uint64_t>(f32Bytes));
-        encoder.CopyBufferToBuffer(outMu2Buffer, 0, readbackMu2Buffer, 0, static_cast<std::uint64_t>(f32Bytes));
-        encoder.CopyBufferToBuffer(outVar1Buffer, 0, readbackVar1Buffer, 0, static_cast<std::uint64_t>(f32Bytes));
-        encoder.CopyBufferToBuffer(outVar2Buffer, 0, readbackVar2Buffer, 0, static_cast<std::uint64_t>(f32Bytes));
-        encoder.CopyBufferToBuffer(outCov12Buffer, 0, readbackCov12Buffer, 0, static_cast<std::uint64_t>(f32Bytes));
+    PooledBuffer levelStatsPooled = EncodeReduceLevels(ctx, frame, reduce, dssimQBuffer, dssimQBytes, reduceLevels);
+    const std::size_t levelStatsReadback =
+        frame.ScheduleReadback(std::move(levelStatsPooled), reduceLevels.size() * sizeof(LevelStatsData));
+    for (Stage0Pending& pending : pendings) {
+        pending.levelStatsReadback = levelStatsReadback;
+        pending.dssimQ = dssimQBuffer;
+        pending.dssimQBytes = dssimQBytes;
+        pending.reduceLevel = reduceLevels[pending.levelStatsIndex];
     }
-
-    wgpu::CommandBuffer commandBuffer = encoder.Finish();
-    queue.Submit(1, &commandBuffer);
     const auto finish_DispatchAndSubmit = std::chrono::steady_clock::now();
-    outputs.dispatchAndSubmit_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_DispatchAndSubmit - start_DispatchAndSubmit);
+    first.dispatchAndSubmit_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_DispatchAndSubmit - start_DispatchAndSubmit);
+    return pendings;
+}
 
-    
-    outputs.width = width;
-    outputs.height = height;
-    const auto start_Readback = std::chrono::steady_clock::now();
-    const auto dssimBytes = ReadBufferBlocking(instance, readbackDssimQBuffer, u32Bytes);
-    outputs.dssimQ.resize(elemCount);
-    std::memcpy(outputs.dssimQ.data(), dssimBytes.data(), u32Bytes);
-    if (readIntermediateStats) {
-        const auto mu1Bytes = ReadBufferBlocking(instance, readbackMu1Buffer, f32Bytes);
-        const auto mu2Bytes = ReadBufferBlocking(instance, readbackMu2Buffer, f32Bytes);
-        const auto var1Bytes = ReadBufferBlocking(instance, readbackVar1Buffer, f32Bytes);
-        const auto var2Bytes = ReadBufferBlocking(instance, readbackVar2Buffer, f32Bytes);
-        const auto cov12Bytes = ReadBufferBlocking(instance, readbackCov12Buffer, f32Bytes);
-        outputs.mu1.resize(elemCount);
-        outputs.mu2.resize(elemCount);
-        outputs.var1.resize(elemCount);
-        outputs.var2.resize(elemCount);
-        outputs.cov12.resize(elemCount);
-        std::memcpy(outputs.mu1.data(), mu1Bytes.data(), f32Bytes);
-        std::memcpy(outputs.mu2.data(), mu2Bytes.data(), f32Bytes);
-        std::memcpy(outputs.var1.data(), var1Bytes.data(), f32Bytes);
-        std::memcpy(outputs.var2.data(), var2Bytes.data(), f32Bytes);
-        std::memcpy(outputs.cov12.data(), cov12Bytes.data(), f32Bytes);
+// Fills the score fields of `outputs` (width and height already set) from one level's
+// reduced map: the sum of q and the count and sum of the q above threshold, which must be
+// DssimDeviationThreshold of that sum.
+void ScoreScale(
+    ScaleOutputs& outputs,
+    std::uint64_t sum,
+    std::uint32_t threshold,
+    std::uint32_t hiCount,
+    std::uint64_t hiSum,
+    std::uint32_t scaleLevel) {
+    const std::size_t elemCount = static_cast<std::size_t>(outputs.width) * static_cast<std::size_t>(outputs.height);
+    const double n = static_cast<double>(elemCount);
+    const double q = static_cast<double>(kStage0QScale);
+    outputs.elemCount = elemCount;
+    outputs.dssimQSum = sum;
+    outputs.meanDssim = static_cast<double>(sum) / (n * q);
+
+    // ssim_i = 1 - 2 q_i / Q, so |avg - ssim_i| = (2 / Q) |q_i - t| with t = (1 - avg) Q / 2.
+    // Every integer q above floor(t) is above t and every other one is not, so splitting the
+    // sums there is exact.
+    const double t = DssimDeviationCenter(sum, elemCount, kStage0QScale, scaleLevel);
+    if (threshold != DssimDeviationThreshold(sum, elemCount, kStage0QScale, scaleLevel)) {
+        throw std::runtime_error("level " + std::to_string(scaleLevel) + " was partitioned away from floor(t)");
+    }
+    const double hi = static_cast<double>(hiCount);
+    const double loSum = static_cast<double>(sum - hiSum);
+    const double absDevQ = (static_cast<double>(hiSum) - hi * t) + ((n - hi) * t - loSum);
+    const double devSum = 2.0 * absDevQ / q;
+    outputs.ssimScore = 1.0 - (devSum / n);
+}
+
+// Turns the readback of one encoded stage0 level and its resolved stats into its scale
+// score. Must be called after frame.SubmitAndWait().
+// Copies the dssim map and debug planes that pending scheduled for readback into outputs.
+void ReadStage0Planes(const GpuFrame& frame, const Stage0Pending& pending, ScaleOutputs& outputs) {
+    if (pending.hasDssimQ) {
+        outputs.dssimQ = frame.ReadbackAs<std::uint32_t>(pending.dssimQReadback);
+    }
+    if (pending.hasIntermediateStats) {
+        outputs.mu1 = frame.ReadbackAs<float>(pending.statsReadbacks[0]);
+        outputs.mu2 = frame.ReadbackAs<float>(pending.statsReadbacks[1]);
+        outputs.var1 = frame.ReadbackAs<float>(pending.statsReadbacks[2]);
+        outputs.var2 = frame.ReadbackAs<float>(pending.statsReadbacks[3]);
+        outputs.cov12 = frame.ReadbackAs<float>(pending.statsReadbacks[4]);
     }
+}
+
+ScaleOutputs FinishStage0Compute(const GpuFrame& frame, const Stage0Pending& pending, const LevelStatsData& stats) {
+    ScaleOutputs outputs;
+    outputs.width = pending.width;
+    outputs.height = pending.height;
+    outputs.createBuffers_time = pending.createBuffers_time;
+    outputs.writeInputBuffers_time = pending.writeInputBuffers_time;
+    outputs.createBindGroups_time = pending.createBindGroups_time;
+    outputs.dispatchAndSubmit_time = pending.dispatchAndSubmit_time;
+
+    const auto start_Readback = std::chrono::steady_clock::now();
+    ReadStage0Planes(frame, pending, outputs);
     const auto finish_Readback = std::chrono::steady_clock::now();
     outputs.readback_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_Readback - start_Readback);
 
     const auto start_PostProcess = std::chrono::steady_clock::now();
-    std::uint64_t sum = 0;
-    for (std::uint32_t v : outputs.dssimQ) {
-        sum += static_cast<std::uint64_t>(v);
-    }
-    outputs.dssimQSum = sum;
-    outputs.meanDssim =
-        static_cast<double>(sum) / (static_cast<double>(elemCount) * static_cast<double>(paramsData.qscale));
-
-    std::vector<double> ssimMap(elemCount);
-    double ssimSum = 0.0;
-    for (std::size_t i = 0; i < elemCount; ++i) {
-        const double dssim = static_cast<double>(outputs.dssimQ[i]) / static_cast<double>(paramsData.qscale);
-        const double ssim = 1.0 - 2.0 * dssim;
-        ssimMap[i] = ssim;
-        ssimSum += ssim;
-    }
-    const double meanSsim = ssimSum / static_cast<double>(elemCount);
-    const double avg =
-        std::pow(std::max(meanSsim, 0.0), std::pow(0.5, static_cast<double>(scaleLevel)));
-    double devSum = 0.0;
-    for (double s : ssimMap) {
-        devSum += std::abs(avg - s);
-    }
-    outputs.ssimScore = 1.0 - (devSum / static_cast<double>(elemCount));
+    ScoreScale(outputs, stats.sum, stats.threshold, stats.hiCount, stats.hiSum,
+               static_cast<std::uint32_t>(pending.scaleLevel));
     const auto finish_PostProcess = std::chrono::steady_clock::now();
     outputs.postProcess_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_PostProcess - start_PostProcess);
     return outputs;
 }
 
-DownsampleOutputs RunDownsample2x2Compute(
-    const wgpu::Instance& instance,
-    const wgpu::Device& device,
-    const std::vector<LinearRgba>& input,
-    std::uint32_t inWidth,
-    std::uint32_t inHeight,
-    const std::string& shaderSource) {
-    const std::size_t inCount = static_cast<std::size_t>(inWidth) * static_cast<std::size_t>(inHeight);
-    if (input.size() != inCount) {
-        throw std::runtime_error("downsample input size mismatch");
-    }
-    const std::uint32_t outWidth = inWidth / 2u;
-    const std::uint32_t outHeight = inHeight / 2u;
-    if (outWidth == 0 || outHeight == 0) {
-        throw std::runtime_error("downsample output dimensions are zero");
-    }
-    const std::size_t outCount = static_cast<std::size_t>(outWidth) * static_cast<std::size_t>(outHeight);
-
-    const std::size_t inBytes = inCount * sizeof(LinearRgba);
-    const std::size_t outBytes = outCount * sizeof(LinearRgba);
-
+// Records every pyramid level 1..levelCount of both level-0 images in one dispatch of
+// downsample_pyramid.wgsl. Buffer-backed levels share one pooled buffer per image, each
+// level at a 256-byte aligned offset so that it can be bound on its own; texture-backed
+// levels are the mips of one two-layer pyramid texture. Level 1 is only scheduled for
+// readback when readbackFirstLevel is set; the host copies are then available through
+// ReadDownsamplePixels after the submit.
+DownsampleOutputs EncodeDownsamplePyramid(
+    GpuContext& ctx,
+    GpuFrame& frame,
+    const GpuImage& input1,
+    const GpuImage& input2,
+    std::uint32_t levelCount,
+    bool readbackFirstLevel) {
+    const wgpu::Device& device = ctx.device;
+    if (input1.width != input2.width || input1.height != input2.height || input1.format != input2.format ||
+        input1.textureBacked != input2.textureBacked) {
+        throw std::runtime_error("downsample input mismatch");
+    }
+    if (input1.format != GpuPixelFormat::Rgba8) {
+        throw std::runtime_error("downsample input is not a packed rgba8 level 0");
+    }
+    if (levelCount == 0 || levelCount > kPyramidMaxLevels) {
+        throw std::runtime_error("unsupported pyramid level count");
+    }
+    const bool textureBacked = input1.textureBacked;
+
+    struct LevelData {
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t offset;
+        std::uint32_t pad0;
+    };
     struct ParamsData {
         std::uint32_t inWidth;
         std::uint32_t inHeight;
-        std::uint32_t outWidth;
-        std::uint32_t outHeight;
+        std::uint32_t levels;
+        std::uint32_t pad0;
+        std::array<LevelData, kPyramidMaxLevels> level;
     };
-    const ParamsData paramsData = {
-        .inWidth = inWidth,
-        .inHeight = inHeight,
-        .outWidth = outWidth,
-        .outHeight = outHeight,
+    ParamsData paramsData = {
+        .inWidth = input1.width,
+        .inHeight = input1.height,
+        .levels = levelCount,
+        .pad0 = 0,
+        .level = {},
     };
+    // WebGPU's default minStorageBufferOffsetAlignment.
+    constexpr std::uint64_t kLevelAlignment = 256u;
+    std::uint64_t pyramidBytes = 0;
+    for (std::uint32_t k = 0, w = input1.width, h = input1.height; k < levelCount; ++k) {
+        w /= 2u;
+        h /= 2u;
+        if (w == 0 || h == 0) {
+            throw std::runtime_error("downsample output dimensions are zero");
+        }
+        paramsData.level[k] = {
+            .width = w,
+            .height = h,
+            .offset = static_cast<std::uint32_t>(pyramidBytes / sizeof(LinearRgba)),
+            .pad0 = 0,
+        };
+        const std::uint64_t levelBytes = static_cast<std::uint64_t>(w) * h * sizeof(LinearRgba);
+        pyramidBytes += (levelBytes + kLevelAlignment - 1u) & ~(kLevelAlignment - 1u);
+    }
+
     DownsampleOutputs out;
+    out.levels.resize(levelCount);
     const auto start_CreateBuffers = std::chrono::steady_clock::now();
-
-    wgpu::BufferDescriptor inDesc = {};
-    inDesc.size = static_cast<std::uint64_t>(inBytes);
-    inDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
-    inDesc.mappedAtCreation = false;
-    wgpu::Buffer inBuffer = device.CreateBuffer(&inDesc);
-
-    wgpu::BufferDescriptor outDesc = {};
-    outDesc.size = static_cast<std::uint64_t>(outBytes);
-    outDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc;
-    outDesc.mappedAtCreation = false;
-    wgpu::Buffer outBuffer = device.CreateBuffer(&outDesc);
-
-    wgpu::BufferDescriptor readbackDesc = {};
-    readbackDesc.size = static_cast<std::uint64_t>(outBytes);
-    readbackDesc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead;
-    readbackDesc.mappedAtCreation = false;
-    wgpu::Buffer readbackBuffer = device.CreateBuffer(&readbackDesc);
-
-    wgpu::BufferDescriptor paramsDesc = {};
-    paramsDesc.size = static_cast<std::uint64_t>(sizeof(ParamsData));
-    paramsDesc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
-    paramsDesc.mappedAtCreation = false;
-    wgpu::Buffer paramsBuffer = device.CreateBuffer(&paramsDesc);
-
-    if (!inBuffer || !outBuffer || !readbackBuffer || !paramsBuffer) {
-        throw std::runtime_error("failed to create downsample buffers");
+    wgpu::Texture& pyramid = out.texture;
+    std::array<wgpu::Buffer, 2>& pyramidBuffers = out.buffers;
+    if (textureBacked) {
+        pyramid = CreatePyramidTexture(ctx, paramsData.level[0].width, paramsData.level[0].height, levelCount);
+    } else {
+        for (wgpu::Buffer& buffer : pyramidBuffers) {
+            buffer = frame.Retain(
+                ctx.bufferPool.Acquire(wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc, pyramidBytes));
+        }
+        out.bufferBytes = pyramidBytes;
+    }
+    for (std::uint32_t k = 0; k < levelCount; ++k) {
+        const LevelData& level = paramsData.level[k];
+        for (std::uint32_t i = 0; i < 2; ++i) {
+            if (textureBacked) {
+                out.levels[k][i] = PyramidLevelImage(pyramid, i, k, level.width, level.height);
+            } else {
+                GpuImage& image = out.levels[k][i];
+                image.width = level.width;
+                image.height = level.height;
+                image.buffer = pyramidBuffers[i];
+                image.bufferOffset = static_cast<std::uint64_t>(level.offset) * sizeof(LinearRgba);
+            }
+        }
     }
     const auto finish_CreateBuffers = std::chrono::steady_clock::now();
     out.createBuffers_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateBuffers - start_CreateBuffers);
 
-    wgpu::Queue queue = device.GetQueue();
     const auto start_WriteInputBuffers = std::chrono::steady_clock::now();
-    queue.WriteBuffer(inBuffer, 0, input.data(), inBytes);
-    queue.WriteBuffer(paramsBuffer, 0, &paramsData, sizeof(ParamsData));
+    const wgpu::Buffer paramsBuffer = frame.Upload(wgpu::BufferUsage::Uniform, &paramsData, sizeof(ParamsData));
     const auto finish_WriteInputBuffers = std::chrono::steady_clock::now();
     out.writeInputBuffers_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_WriteInputBuffers - start_WriteInputBuffers);
-    const auto start_CreateShaderModule = std::chrono::steady_clock::now();
-    wgpu::ShaderModule shader = CreateShaderModule(device, shaderSource);
-    const auto finish_CreateShaderModule = std::chrono::steady_clock::now();
-    out.createShaderModule_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateShaderModule - start_CreateShaderModule);
-    if (!shader) {
-        throw std::runtime_error("failed to create downsample shader module");
-    }
-    const auto start_CreatePipelineLayouts = std::chrono::steady_clock::now();
-
-    wgpu::BindGroupLayoutEntry layoutEntries[3] = {};
-    layoutEntries[0].binding = 0;
-    layoutEntries[0].visibility = wgpu::ShaderStage::Compute;
-    layoutEntries[0].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
-    layoutEntries[1].binding = 1;
-    layoutEntries[1].visibility = wgpu::ShaderStage::Compute;
-    layoutEntries[1].buffer.type = wgpu::BufferBindingType::Storage;
-    layoutEntries[2].binding = 2;
-    layoutEntries[2].visibility = wgpu::ShaderStage::Compute;
-    layoutEntries[2].buffer.type = wgpu::BufferBindingType::Uniform;
-    layoutEntries[2].buffer.minBindingSize = sizeof(ParamsData);
-
-    wgpu::BindGroupLayoutDescriptor bglDesc = {};
-    bglDesc.entryCount = 3;
-    bglDesc.entries = layoutEntries;
-    wgpu::BindGroupLayout bindGroupLayout = device.CreateBindGroupLayout(&bglDesc);
-
-    wgpu::PipelineLayoutDescriptor plDesc = {};
-    plDesc.bindGroupLayoutCount = 1;
-    plDesc.bindGroupLayouts = &bindGroupLayout;
-    wgpu::PipelineLayout pipelineLayout = device.CreatePipelineLayout(&plDesc);
-
-    wgpu::ComputePipelineDescriptor pipelineDesc = {};
-    pipelineDesc.layout = pipelineLayout;
-    pipelineDesc.compute.module = shader;
-    pipelineDesc.compute.entryPoint = "main";
-    auto start_createPSO = std::chrono::high_resolution_clock::now();
-    wgpu::ComputePipeline pipeline = device.CreateComputePipeline(&pipelineDesc);
-    auto finish_createPSO = std::chrono::high_resolution_clock::now();
-    out.createPSO_time = duration_cast<milliseconds>(finish_createPSO - start_createPSO);
-
-    if (!bindGroupLayout || !pipelineLayout || !pipeline) {
-        throw std::runtime_error("failed to create downsample pipeline");
-    }
-    const auto finish_CreatePipelineLayouts = std::chrono::steady_clock::now();
-    out.createPipelineLayouts_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreatePipelineLayouts - start_CreatePipelineLayouts);
     const auto start_CreateBindGroups = std::chrono::steady_clock::now();
 
-    wgpu::BindGroupEntry bgEntries[3] = {};
-    bgEntries[0].binding = 0;
-    bgEntries[0].buffer = inBuffer;
-    bgEntries[0].size = static_cast<std::uint64_t>(inBytes);
-    bgEntries[1].binding = 1;
-    bgEntries[1].buffer = outBuffer;
-    bgEntries[1].size = static_cast<std::uint64_t>(outBytes);
-    bgEntries[2].binding = 2;
-    bgEntries[2].buffer = paramsBuffer;
-    bgEntries[2].size = static_cast<std::uint64_t>(sizeof(ParamsData));
-
-    wgpu::BindGroupDescriptor bgDesc = {};
-    bgDesc.layout = bindGroupLayout;
-    bgDesc.entryCount = 3;
-    bgDesc.entries = bgEntries;
-    wgpu::BindGroup bindGroup = device.CreateBindGroup(&bgDesc);
-    if (!bindGroup) {
-        throw std::runtime_error("failed to create downsample bind group");
-    }
+    wgpu::BindGroup bindGroup;
+    if (textureBacked) {
+        // One two-layer view per mip. Levels past levelCount are never written; their
+        // bindings repeat the last mip.
+        std::array<wgpu::TextureView, kPyramidMaxLevels> mipViews;
+        for (std::uint32_t k = 0; k < kPyramidMaxLevels; ++k) {
+            wgpu::TextureViewDescriptor viewDesc = {};
+            viewDesc.dimension = wgpu::TextureViewDimension::e2DArray;
+            viewDesc.baseMipLevel = std::min(k, levelCount - 1u);
+            viewDesc.mipLevelCount = 1;
+            mipViews[k] = pyramid.CreateView(&viewDesc);
+        }
+        bindGroup = CreateBindGroup(
+            device, ctx.downsampleTextureBgl,
+            {{.textureView = input1.view},
+             {.textureView = mipViews[0]},
+             {paramsBuffer, sizeof(ParamsData)},
+             {.textureView = input2.view},
+             {.textureView = mipViews[1]},
+             {.textureView = mipViews[2]},
+             {.textureView = mipViews[3]}},
+            "downsample texture");
+    } else {
+        bindGroup = CreateBindGroup(
+            device, ctx.downsampleBgl,
+            {BufferBinding(input1),
+             {pyramidBuffers[0], pyramidBytes},
+             {paramsBuffer, sizeof(ParamsData)},
+             BufferBinding(input2),
+             {pyramidBuffers[1], pyramidBytes}},
+            "downsample");
+    }
+    const wgpu::ComputePipeline& pipeline = textureBacked ? ctx.downsampleTexturePipeline : ctx.downsamplePipeline;
     const auto finish_CreateBindGroups = std::chrono::steady_clock::now();
     out.createBindGroups_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateBindGroups - start_CreateBindGroups);
     const auto start_DispatchAndSubmit = std::chrono::steady_clock::now();
 
-    wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
     {
         wgpu::ComputePassDescriptor passDesc = {};
-        wgpu::ComputePassEncoder pass = encoder.BeginComputePass(&passDesc);
+        wgpu::ComputePassEncoder pass = frame.encoder().BeginComputePass(&passDesc);
         pass.SetPipeline(pipeline);
         pass.SetBindGroup(0, bindGroup);
-        const std::uint32_t workgroupCount = static_cast<std::uint32_t>((outCount + 63u) / 64u);
-        pass.DispatchWorkgroups(workgroupCount, 1, 1);
+        pass.DispatchWorkgroups(
+            (input1.width + kPyramidRegionSize - 1u) / kPyramidRegionSize,
+            (input1.height + kPyramidRegionSize - 1u) / kPyramidRegionSize,
+            2);
         pass.End();
     }
-    encoder.CopyBufferToBuffer(outBuffer, 0, readbackBuffer, 0, static_cast<std::uint64_t>(outBytes));
-    wgpu::CommandBuffer cb = encoder.Finish();
-    queue.Submit(1, &cb);
+    if (readbackFirstLevel) {
+        const std::uint32_t outWidth = paramsData.level[0].width;
+        const std::uint32_t outHeight = paramsData.level[0].height;
+        const std::size_t rowBytes = static_cast<std::size_t>(outWidth) * sizeof(LinearRgba);
+        // Buffer copies of a texture need 256-byte aligned rows; ReadDownsamplePixels
+        // strips the padding again.
+        out.pixelsRowPitch = textureBacked ? ((rowBytes + 255u) & ~std::size_t{255}) : rowBytes;
+        const std::size_t snapshotBytes = out.pixelsRowPitch * outHeight;
+        for (std::uint32_t i = 0; i < 2; ++i) {
+            // ScheduleReadback copies from offset 0 of a buffer it owns, so snapshot level 1
+            // into one.
+            PooledBuffer snapshot = ctx.bufferPool.Acquire(
+                wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::CopySrc, snapshotBytes);
+            if (textureBacked) {
+                wgpu::TexelCopyTextureInfo source = {};
+                source.texture = pyramid;
+                source.mipLevel = 0;
+                source.origin = {0, 0, i};
+                wgpu::TexelCopyBufferInfo destination = {};
+                destination.buffer = snapshot.Get();
+                destination.layout.bytesPerRow = static_cast<std::uint32_t>(out.pixelsRowPitch);
+                destination.layout.rowsPerImage = outHeight;
+                const wgpu::Extent3D extent = {outWidth, outHeight, 1};
+                frame.encoder().CopyTextureToBuffer(&source, &destination, &extent);
+            } else {
+                frame.encoder().CopyBufferToBuffer(
+                    pyramidBuffers[i], 0, snapshot.Get(), 0, static_cast<std::uint64_t>(snapshotBytes));
+            }
+            out.pixelsReadback[i] = frame.ScheduleReadback(std::move(snapshot), snapshotBytes);
+        }
+        out.hasPixelsReadback = true;
+    }
     const auto finish_DispatchAndSubmit = std::chrono::steady_clock::now();
     out.dispatchAndSubmit_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_DispatchAndSubmit - start_DispatchAndSubmit);
-
-    const auto start_Readback = std::chrono::steady_clock::now();
-    const auto outBytesVec = ReadBufferBlocking(instance, readbackBuffer, outBytes);
-    out.width = outWidth;
-    out.height = outHeight;
-    out.pixels.resize(outCount);
-    std::memcpy(out.pixels.data(), outBytesVec.data(), outBytes);
-    const auto finish_Readback = std::chrono::steady_clock::now();
-    out.readback_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_Readback - start_Readback);
     return out;
 }
 
-wgpu::Adapter RequestAdapterBlocking(const wgpu::Instance& instance) {
+// Host copy of level 1 of image `index` of a pyramid scheduled with readbackFirstLevel,
+// with any row padding removed.
+std::vector<LinearRgba> ReadDownsamplePixels(const GpuFrame& frame, const DownsampleOutputs& next, std::size_t index) {
+    const GpuImage& image = next.levels.at(0).at(index);
+    const std::vector<std::uint8_t> bytes = frame.ReadbackAs<std::uint8_t>(next.pixelsReadback[index]);
+    const std::size_t rowBytes = static_cast<std::size_t>(image.width) * sizeof(LinearRgba);
+    std::vector<LinearRgba> pixels(image.pixelCount());
+    if (bytes.size() < next.pixelsRowPitch * image.height) {
+        throw std::runtime_error("downsample readback is truncated");
+    }
+    for (std::uint32_t y = 0; y < image.height; ++y) {
+        std::memcpy(
+            reinterpret_cast<std::uint8_t*>(pixels.data()) + y * rowBytes,
+            bytes.data() + y * next.pixelsRowPitch,
+            rowBytes);
+    }
+    return pixels;
+}
+
+wgpu::Adapter RequestAdapterBlocking(const wgpu::Instance& instance, bool forceFallbackAdapter) {
     struct RequestState {
-        std::atomic<bool> done{false};
         wgpu::RequestAdapterStatus status = wgpu::RequestAdapterStatus::Error;
         wgpu::Adapter adapter = nullptr;
         std::string message;
@@ -1211,20 +2095,17 @@ wgpu::Adapter RequestAdapterBlocking(const wgpu::Instance& instance) {
 #if defined(_WIN32)
     options.backendType = wgpu::BackendType::D3D12;
 #endif
-    instance.RequestAdapter(
+    options.forceFallbackAdapter = forceFallbackAdapter;
+    std::vector<wgpu::FutureWaitInfo> waits(1);
+    waits[0].future = instance.RequestAdapter(
         &options,
-        wgpu::CallbackMode::AllowProcessEvents,
+        wgpu::CallbackMode::WaitAnyOnly,
         [&state](wgpu::RequestAdapterStatus status, wgpu::Adapter adapter, const char* message) {
             state.status = status;
             state.adapter = adapter;
             state.message = (message != nullptr) ? std::string(message) : std::string();
-            state.done.store(true, std::memory_order_release);
         });
-
-    while (!state.done.load(std::memory_order_acquire)) {
-        instance.ProcessEvents();
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
+    WaitAllBlocking(instance, waits, "RequestAdapter");
 
     if (state.status != wgpu::RequestAdapterStatus::Success || !state.adapter) {
         std::string message = "failed to request adapter";
@@ -1237,29 +2118,33 @@ wgpu::Adapter RequestAdapterBlocking(const wgpu::Instance& instance) {
     return state.adapter;
 }
 
-wgpu::Device RequestDeviceBlocking(const wgpu::Instance& instance, const wgpu::Adapter& adapter) {
+wgpu::Device RequestDeviceBlocking(
+    const wgpu::Instance& instance,
+    const wgpu::Adapter& adapter,
+    const std::vector<wgpu::FeatureName>& requiredFeatures,
+    const wgpu::Limits* requiredLimits = nullptr) {
     struct RequestState {
-        std::atomic<bool> done{false};
         wgpu::RequestDeviceStatus status = wgpu::RequestDeviceStatus::Error;
         wgpu::Device device = nullptr;
         std::string message;
     };
     RequestState state;
 
-    adapter.RequestDevice(
-        nullptr,
-        wgpu::CallbackMode::AllowProcessEvents,
+    wgpu::DeviceDescriptor deviceDesc = {};
+    deviceDesc.requiredFeatureCount = requiredFeatures.size();
+    deviceDesc.requiredFeatures = requiredFeatures.data();
+    deviceDesc.requiredLimits = requiredLimits;
+
+    std::vector<wgpu::FutureWaitInfo> waits(1);
+    waits[0].future = adapter.RequestDevice(
+        &deviceDesc,
+        wgpu::CallbackMode::WaitAnyOnly,
         [&state](wgpu::RequestDeviceStatus status, wgpu::Device device, const char* message) {
             state.status = status;
             state.device = device;
             state.message = (message != nullptr) ? std::string(message) : std::string();
-            state.done.store(true, std::memory_order_release);
         });
-
-    while (!state.done.load(std::memory_order_acquire)) {
-        instance.ProcessEvents();
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
+    WaitAllBlocking(instance, waits, "RequestDevice");
 
     if (state.status != wgpu::RequestDeviceStatus::Success || !state.device) {
         std::string message = "failed to request device";
@@ -1272,17 +2157,871 @@ wgpu::Device RequestDeviceBlocking(const wgpu::Instance& instance, const wgpu::A
     return state.device;
 }
 
+wgpu::BindGroupLayout CreateBufferBindGroupLayout(
+    const wgpu::Device& device,
+    const std::vector<wgpu::BufferBindingType>& bindingTypes,
+    const char* what) {
+    std::vector<wgpu::BindGroupLayoutEntry> entries(bindingTypes.size());
+    for (std::size_t i = 0; i < bindingTypes.size(); ++i) {
+        entries[i].binding = static_cast<std::uint32_t>(i);
+        entries[i].visibility = wgpu::ShaderStage::Compute;
+        entries[i].buffer.type = bindingTypes[i];
+        entries[i].buffer.minBindingSize = 0;
+    }
+
+    wgpu::BindGroupLayoutDescriptor bglDesc = {};
+    bglDesc.entryCount = entries.size();
+    bglDesc.entries = entries.data();
+    wgpu::BindGroupLayout layout = device.CreateBindGroupLayout(&bglDesc);
+    if (!layout) {
+        throw std::runtime_error(std::string("failed to create ") + what + " bind group layout");
+    }
+    return layout;
+}
+
+// Bindings 0 and 3 are the two images' sampled (unfilterable float) 2D textures and
+// binding 2 the uniform params. Binding 1 is either the shared storage buffer output or,
+// with storageTextureOutput, pyramid mips 0..3 as write-only rgba32float 2D-array storage
+// textures at bindings 1, 4, 5 and 6.
+wgpu::BindGroupLayout CreateTextureInputBindGroupLayout(
+    const wgpu::Device& device,
+    bool storageTextureOutput,
+    const char* what) {
+    std::vector<wgpu::BindGroupLayoutEntry> entries(storageTextureOutput ? 7 : 4);
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        entries[i].binding = static_cast<std::uint32_t>(i);
+        entries[i].visibility = wgpu::ShaderStage::Compute;
+    }
+    for (const std::size_t input : {0u, 3u}) {
+        entries[input].texture.sampleType = wgpu::TextureSampleType::UnfilterableFloat;
+        entries[input].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    }
+    if (storageTextureOutput) {
+        for (const std::size_t output : {1u, 4u, 5u, 6u}) {
+            entries[output].storageTexture.access = wgpu::StorageTextureAccess::WriteOnly;
+            entries[output].storageTexture.format = wgpu::TextureFormat::RGBA32Float;
+            entries[output].storageTexture.viewDimension = wgpu::TextureViewDimension::e2DArray;
+        }
+    } else {
+        entries[1].buffer.type = wgpu::BufferBindingType::Storage;
+    }
+    entries[2].buffer.type = wgpu::BufferBindingType::Uniform;
+
+    wgpu::BindGroupLayoutDescriptor bglDesc = {};
+    bglDesc.entryCount = entries.size();
+    bglDesc.entries = entries.data();
+    wgpu::BindGroupLayout layout = device.CreateBindGroupLayout(&bglDesc);
+    if (!layout) {
+        throw std::runtime_error(std::string("failed to create ") + what + " bind group layout");
+    }
+    return layout;
+}
+
+wgpu::ComputePipeline CreateComputePipelineForLayout(
+    GpuContext& ctx,
+    const wgpu::ShaderModule& shader,
+    const wgpu::BindGroupLayout& bindGroupLayout,
+    const char* what,
+    const char* entryPoint = "main",
+    const std::vector<wgpu::ConstantEntry>& constants = {}) {
+    const auto start_CreatePipelineLayouts = std::chrono::steady_clock::now();
+    wgpu::PipelineLayoutDescriptor plDesc = {};
+    plDesc.bindGroupLayoutCount = 1;
+    plDesc.bindGroupLayouts = &bindGroupLayout;
+    wgpu::PipelineLayout pipelineLayout = ctx.device.CreatePipelineLayout(&plDesc);
+    if (!pipelineLayout) {
+        throw std::runtime_error(std::string("failed to create ") + what + " pipeline layout");
+    }
+    const auto finish_CreatePipelineLayouts = std::chrono::steady_clock::now();
+    ctx.createPipelineLayouts_time += std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreatePipelineLayouts - start_CreatePipelineLayouts);
+
+    wgpu::ComputePipelineDescriptor pipelineDesc = {};
+    pipelineDesc.layout = pipelineLayout;
+    pipelineDesc.compute.module = shader;
+    pipelineDesc.compute.entryPoint = entryPoint;
+    pipelineDesc.compute.constantCount = constants.size();
+    pipelineDesc.compute.constants = constants.data();
+    const auto start_createPSO = std::chrono::high_resolution_clock::now();
+    wgpu::ComputePipeline pipeline = ctx.device.CreateComputePipeline(&pipelineDesc);
+    const auto finish_createPSO = std::chrono::high_resolution_clock::now();
+    ctx.createPSO_time += duration_cast<milliseconds>(finish_createPSO - start_createPSO);
+    if (!pipeline) {
+        throw std::runtime_error(std::string("failed to create ") + what + " compute pipeline");
+    }
+    return pipeline;
+}
+
+// Prepended to the shaders that touch Lab planes; defines the storage scalar lab_t.
+std::string LabShaderPrelude(bool labF16) {
+    return labF16 ? "enable f16;\nalias lab_t = f16;\n" : "alias lab_t = f32;\n";
+}
+
+// Builds the four reduce pipelines of shader (ssim_reduce.wgsl, or with the subgroup
+// entry points when subgroup is set) with tuning's override constants.
+ReducePipelines CreateReducePipelines(
+    GpuContext& ctx,
+    const wgpu::ShaderModule& shader,
+    bool subgroup,
+    const ReduceTuning& tuning) {
+    const std::vector<wgpu::ConstantEntry> constants = {
+        {.key = "WG", .value = static_cast<double>(tuning.workgroupSize)},
+        {.key = "MAX_GROUPS", .value = static_cast<double>(tuning.maxGroups)},
+    };
+    const std::string suffix = subgroup ? "_subgroup" : "";
+    const auto create = [&](const char* entry) {
+        const std::string entryPoint = entry + suffix;
+        const std::string what = "reduce " + entryPoint;
+        return CreateComputePipelineForLayout(
+            ctx, shader, ctx.reduceBgl, what.c_str(), entryPoint.c_str(), constants);
+    };
+    ReducePipelines pipelines;
+    pipelines.tuning = tuning;
+    pipelines.sumPartials = create("sum_partials");
+    pipelines.sumFinal = create("sum_final");
+    pipelines.partitionPartials = create("partition_partials");
+    pipelines.partitionFinal = create("partition_final");
+    return pipelines;
+}
+
+// Rebuilds ctx.reduce and ctx.subgroupReduce for tuning.
+void ApplyReduceTuning(GpuContext& ctx, const ReduceTuning& tuning) {
+    ctx.reduce = CreateReducePipelines(ctx, ctx.reduceShader, false, tuning);
+    ctx.subgroupReduce =
+        ctx.subgroups ? CreateReducePipelines(ctx, ctx.subgroupReduceShader, true, tuning) : ctx.reduce;
+}
+
+// Workgroup memory of ssim_fused.wgsl for output tile `tile`; see its header comment.
+std::uint64_t FusedWorkgroupBytes(const TileShape& tile) {
+    const std::uint64_t rawArea = static_cast<std::uint64_t>(tile.x + 8u) * (tile.y + 8u);
+    const std::uint64_t habArea = static_cast<std::uint64_t>(tile.y + 8u) * (tile.x + 4u);
+    const std::uint64_t midArea = static_cast<std::uint64_t>(tile.x + 4u) * (tile.y + 4u);
+    const std::uint64_t hmArea = static_cast<std::uint64_t>(tile.y + 4u) * tile.x;
+    return sizeof(float) * (4u * rawArea + 4u * habArea + 6u * midArea + 5u * hmArea);
+}
+
+// Workgroup memory of stage0_absdiff.wgsl for tile `tile`, which is more than the
+// lab_preprocess.wgsl blur needs for the same tile.
+std::uint64_t LabWorkgroupBytes(const TileShape& tile) {
+    const std::uint64_t spanArea = static_cast<std::uint64_t>(tile.x + 4u) * (tile.y + 4u);
+    const std::uint64_t hArea = static_cast<std::uint64_t>(tile.x) * (tile.y + 4u);
+    return sizeof(float) * (6u * spanArea + 5u * hArea);
+}
+
+// Whether both tiles of tuning are --autotune candidates whose workgroup memory fits the
+// device; cache entries are checked the same way, as for ReduceTuning.
+bool IsAutotuneCandidate(const GpuContext& ctx, const StageTuning& tuning) {
+    const auto known = [](const TileShape& tile) {
+        return std::find(kAutotuneTileShapes.begin(), kAutotuneTileShapes.end(), tile) != kAutotuneTileShapes.end();
+    };
+    return known(tuning.fused) && known(tuning.lab) &&
+           FusedWorkgroupBytes(tuning.fused) <= ctx.maxWorkgroupStorageSize &&
+           LabWorkgroupBytes(tuning.lab) <= ctx.maxWorkgroupStorageSize;
+}
+
+// Rebuilds the per-level pipelines (Lab conversion, blur, stage0 and fused) with tuning's
+// tiles as their override constants and records it in ctx.stageTuning for the dispatches.
+void ApplyStageTuning(GpuContext& ctx, const StageTuning& tuning) {
+    const std::vector<wgpu::ConstantEntry> labConstants = {
+        {.key = "TILE_X", .value = static_cast<double>(tuning.lab.x)},
+        {.key = "TILE_Y", .value = static_cast<double>(tuning.lab.y)},
+    };
+    const std::vector<wgpu::ConstantEntry> fusedConstants = {
+        {.key = "OUT_X", .value = static_cast<double>(tuning.fused.x)},
+        {.key = "OUT_Y", .value = static_cast<double>(tuning.fused.y)},
+    };
+    const auto preprocess = [&](const wgpu::BindGroupLayout& bgl, const char* what, const char* entryPoint) {
+        return CreateComputePipelineForLayout(ctx, ctx.preprocessShader, bgl, what, entryPoint, labConstants);
+    };
+    const auto fused = [&](const wgpu::BindGroupLayout& bgl, const char* what, const char* entryPoint) {
+        return CreateComputePipelineForLayout(ctx, ctx.fusedShader, bgl, what, entryPoint, fusedConstants);
+    };
+    ctx.preprocessConvertPipeline = preprocess(ctx.preprocessConvertBgl, "preprocess convert", "convert");
+    ctx.preprocessConvertRgba8Pipeline =
+        preprocess(ctx.preprocessConvertBgl, "preprocess convert_rgba8", "convert_rgba8");
+    ctx.preprocessConvertTexturePipeline =
+        preprocess(ctx.preprocessTextureBgl, "preprocess convert_texture", "convert_texture");
+    ctx.preprocessConvertTextureSrgb8Pipeline =
+        preprocess(ctx.preprocessTextureBgl, "preprocess convert_texture_srgb8", "convert_texture_srgb8");
+    ctx.preprocessBlurPipeline = preprocess(ctx.preprocessBgl, "preprocess blur", "blur");
+    ctx.stage0Pipeline =
+        CreateComputePipelineForLayout(ctx, ctx.stage0Shader, ctx.stage0Bgl, "stage0", "main", labConstants);
+    ctx.stage0DebugPipeline = CreateComputePipelineForLayout(
+        ctx, ctx.stage0Shader, ctx.stage0DebugBgl, "stage0 debug", "main_debug", labConstants);
+    ctx.fusedPipeline = fused(ctx.preprocessConvertBgl, "fused", "main");
+    ctx.fusedRgba8Pipeline = fused(ctx.preprocessConvertBgl, "fused main_rgba8", "main_rgba8");
+    ctx.fusedTexturePipeline = fused(ctx.preprocessTextureBgl, "fused main_texture", "main_texture");
+    ctx.fusedTextureSrgb8Pipeline =
+        fused(ctx.preprocessTextureBgl, "fused main_texture_srgb8", "main_texture_srgb8");
+    ctx.fusedBatchedPipeline = fused(ctx.preprocessConvertBgl, "fused main_batched", "main_batched");
+    ctx.fusedBatchedTexturePipeline =
+        fused(ctx.preprocessTextureBgl, "fused main_batched_texture", "main_batched_texture");
+    ctx.stageTuning = tuning;
+}
+
+// Tab-free "vendor/device/driver" identity of the adapter for the autotune cache. The
+// backend is part of it because one GPU tunes differently under Vulkan and D3D12.
+std::string AdapterCacheKey(const wgpu::AdapterInfo& info) {
+    std::ostringstream key;
+    key << std::hex << "vendor=" << info.vendorID << ' ' << static_cast<std::string_view>(info.vendor)
+        << "/device=" << info.deviceID << ' ' << static_cast<std::string_view>(info.device)
+        << "/driver=" << static_cast<std::string_view>(info.description) << std::dec
+        << "/backend=" << static_cast<int>(info.backendType);
+    std::string text = key.str();
+    for (char& c : text) {
+        if (c == '\t' || c == '\n' || c == '\r') {
+            c = ' ';
+        }
+    }
+    return text;
+}
+
+GpuContext CreateGpuContext(const ShaderSources& shaders, const CliOptions& options) {
+    dawnProcSetProcs(&dawn::native::GetProcs());
+
+    GpuContext ctx;
+    // TimedWaitAny lets WaitAny block on futures instead of polling ProcessEvents.
+    const wgpu::InstanceFeatureName instanceFeatures[] = {wgpu::InstanceFeatureName::TimedWaitAny};
+    wgpu::InstanceDescriptor instanceDesc = {};
+    instanceDesc.requiredFeatureCount = 1;
+    instanceDesc.requiredFeatures = instanceFeatures;
+    ctx.instance = wgpu::CreateInstance(&instanceDesc);
+    if (!ctx.instance) {
+        throw std::runtime_error("failed to create WGPU instance");
+    }
+
+    ctx.adapter = RequestAdapterBlocking(ctx.instance, options.fallbackAdapter);
+    std::vector<wgpu::FeatureName> requiredFeatures;
+    if (options.labF16) {
+        if (ctx.adapter.HasFeature(wgpu::FeatureName::ShaderF16)) {
+            requiredFeatures.push_back(wgpu::FeatureName::ShaderF16);
+            ctx.labF16 = true;
+        } else {
+            std::cerr << "dssim_gpu_dawn_checksum: adapter lacks shader-f16; using f32 Lab planes\n";
+        }
+    }
+    // No warning when subgroups are missing: the shared-memory reduce is the portable path.
+    if (options.subgroups && ctx.adapter.HasFeature(wgpu::FeatureName::Subgroups)) {
+        requiredFeatures.push_back(wgpu::FeatureName::Subgroups);
+        ctx.subgroups = true;
+    }
+    // Without timestamps --autotune falls back to timing whole submits on the host.
+    if (options.autotune && ctx.adapter.HasFeature(wgpu::FeatureName::TimestampQuery)) {
+        requiredFeatures.push_back(wgpu::FeatureName::TimestampQuery);
+        ctx.timestampQuery = true;
+    }
+    // The larger StageTuning tiles need more workgroup memory than WebGPU's default 16 KiB,
+    // so ask for as much as the adapter has; every other limit stays at its default.
+    wgpu::Limits adapterLimits = {};
+    wgpu::Limits requiredLimits = {};
+    const bool raiseLimits = static_cast<bool>(ctx.adapter.GetLimits(&adapterLimits));
+    if (raiseLimits) {
+        requiredLimits.maxComputeWorkgroupStorageSize = adapterLimits.maxComputeWorkgroupStorageSize;
+    }
+    ctx.device = RequestDeviceBlocking(ctx.instance, ctx.adapter, requiredFeatures, raiseLimits ? &requiredLimits : nullptr);
+    wgpu::Limits deviceLimits = {};
+    if (ctx.device.GetLimits(&deviceLimits)) {
+        ctx.maxWorkgroupStorageSize = deviceLimits.maxComputeWorkgroupStorageSize;
+    }
+    ctx.queue = ctx.device.GetQueue();
+    ctx.bufferPool = GpuBufferPool(ctx.device);
+
+    const std::array<float, 256> srgbLut = BuildSrgbToLinearLut();
+    wgpu::BufferDescriptor lutDesc = {};
+    lutDesc.label = "srgb lut";
+    lutDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+    lutDesc.size = kSrgbLutBytes;
+    ctx.srgbLut = ctx.device.CreateBuffer(&lutDesc);
+    if (!ctx.srgbLut) {
+        throw std::runtime_error("failed to create srgb lut buffer");
+    }
+    ctx.queue.WriteBuffer(ctx.srgbLut, 0, srgbLut.data(), kSrgbLutBytes);
+
+    wgpu::AdapterInfo adapterInfo;
+    if (ctx.adapter.GetInfo(&adapterInfo)) {
+        const std::string_view description = static_cast<std::string_view>(adapterInfo.description);
+        const std::string_view deviceName = static_cast<std::string_view>(adapterInfo.device);
+        if (!description.empty()) {
+            ctx.adapterName = std::string(description);
+        } else if (!deviceName.empty()) {
+            ctx.adapterName = std::string(deviceName);
+        }
+        ctx.adapterKey = AdapterCacheKey(adapterInfo);
+    }
+
+    const auto start_CreateShaderModule = std::chrono::steady_clock::now();
+    const std::string labPrelude = LabShaderPrelude(ctx.labF16);
+    ctx.preprocessShader = CreateShaderModule(ctx.device, labPrelude + shaders.common + shaders.preprocess);
+    ctx.stage0Shader = CreateShaderModule(ctx.device, labPrelude + shaders.common + shaders.stage0);
+    ctx.fusedShader = CreateShaderModule(ctx.device, labPrelude + shaders.common + shaders.fused);
+    wgpu::ShaderModule downsampleShader = CreateShaderModule(ctx.device, shaders.downsample);
+    ctx.reduceShader = CreateShaderModule(ctx.device, shaders.reduce);
+    if (ctx.subgroups) {
+        ctx.subgroupReduceShader =
+            CreateShaderModule(ctx.device, "enable subgroups;\n" + shaders.reduce + shaders.reduceSubgroups);
+    }
+    const auto finish_CreateShaderModule = std::chrono::steady_clock::now();
+    ctx.createShaderModule_time = std::chrono::duration_cast<std::chrono::milliseconds>(finish_CreateShaderModule - start_CreateShaderModule);
+    if (!ctx.preprocessShader || !ctx.stage0Shader || !ctx.fusedShader || !downsampleShader || !ctx.reduceShader ||
+        (ctx.subgroups && !ctx.subgroupReduceShader)) {
+        throw std::runtime_error("failed to create shader modules");
+    }
+
+    using BT = wgpu::BufferBindingType;
+    ctx.preprocessConvertBgl = CreateBufferBindGroupLayout(
+        ctx.device, {BT::ReadOnlyStorage, BT::Storage, BT::Uniform, BT::ReadOnlyStorage, BT::ReadOnlyStorage},
+        "preprocess convert");
+    ctx.preprocessBgl = CreateBufferBindGroupLayout(
+        ctx.device, {BT::ReadOnlyStorage, BT::Storage, BT::Uniform}, "preprocess");
+    ctx.stage0Bgl = CreateBufferBindGroupLayout(
+        ctx.device, {BT::ReadOnlyStorage, BT::Storage, BT::Uniform}, "stage0");
+    ctx.stage0DebugBgl = CreateBufferBindGroupLayout(
+        ctx.device,
+        {BT::ReadOnlyStorage, BT::Storage, BT::Uniform, BT::Storage, BT::Storage, BT::Storage, BT::Storage,
+         BT::Storage},
+        "stage0 debug");
+    ctx.downsampleBgl = CreateBufferBindGroupLayout(
+        ctx.device, {BT::ReadOnlyStorage, BT::Storage, BT::Uniform, BT::ReadOnlyStorage, BT::Storage},
+        "downsample");
+    ctx.reduceBgl = CreateBufferBindGroupLayout(
+        ctx.device, {BT::ReadOnlyStorage, BT::Storage, BT::Storage, BT::Uniform}, "reduce");
+    ctx.preprocessTextureBgl = CreateTextureInputBindGroupLayout(ctx.device, false, "preprocess texture");
+    ctx.downsampleTextureBgl = CreateTextureInputBindGroupLayout(ctx.device, true, "downsample texture");
+
+    ctx.downsamplePipeline = CreateComputePipelineForLayout(ctx, downsampleShader, ctx.downsampleBgl, "downsample");
+    ctx.downsampleTexturePipeline = CreateComputePipelineForLayout(
+        ctx, downsampleShader, ctx.downsampleTextureBgl, "downsample main_texture", "main_texture");
+    ApplyReduceTuning(ctx, ReduceTuning{});
+    ApplyStageTuning(ctx, StageTuning{});
+    return ctx;
+}
+
+// Whether tuning is one of the --autotune candidates; cache entries are checked against
+// them so that a hand-edited file cannot produce an invalid pipeline.
+bool IsAutotuneCandidate(const ReduceTuning& tuning) {
+    return std::find(kAutotuneWorkgroupSizes.begin(), kAutotuneWorkgroupSizes.end(), tuning.workgroupSize) !=
+               kAutotuneWorkgroupSizes.end() &&
+           std::find(kAutotuneMaxGroups.begin(), kAutotuneMaxGroups.end(), tuning.maxGroups) != kAutotuneMaxGroups.end();
+}
+
+// Beginning and end timestamps of the passes given writes(), when the device has
+// TimestampQuery; without it writes() is null and ElapsedNs returns the host time.
+class PassTimestamps {
+public:
+    explicit PassTimestamps(GpuContext& ctx) : ctx_(ctx) {
+        if (!ctx.timestampQuery) {
+            return;
+        }
+        wgpu::QuerySetDescriptor queryDesc = {};
+        queryDesc.type = wgpu::QueryType::Timestamp;
+        queryDesc.count = 2;
+        querySet_ = ctx.device.CreateQuerySet(&queryDesc);
+        if (!querySet_) {
+            throw std::runtime_error("failed to create timestamp query set");
+        }
+        writes_.querySet = querySet_;
+        writes_.beginningOfPassWriteIndex = 0;
+        writes_.endOfPassWriteIndex = 1;
+    }
+
+    const wgpu::PassTimestampWrites* writes() const { return ctx_.timestampQuery ? &writes_ : nullptr; }
+
+    // After the timed passes are encoded: resolves the timestamps into a readback of frame.
+    void Resolve(GpuFrame& frame) {
+        if (!ctx_.timestampQuery) {
+            return;
+        }
+        constexpr std::uint64_t kTimestampBytes = 2u * sizeof(std::uint64_t);
+        PooledBuffer resolved =
+            ctx_.bufferPool.Acquire(wgpu::BufferUsage::QueryResolve | wgpu::BufferUsage::CopySrc, kTimestampBytes);
+        frame.encoder().ResolveQuerySet(querySet_, 0, 2, resolved.Get(), 0);
+        readback_ = frame.ScheduleReadback(std::move(resolved), kTimestampBytes);
+    }
+
+    // After frame.SubmitAndWait(): nanoseconds between the timestamps, or hostNs without them.
+    double ElapsedNs(const GpuFrame& frame, double hostNs) const {
+        if (ctx_.timestampQuery) {
+            const std::vector<std::uint64_t> ticks = frame.ReadbackAs<std::uint64_t>(readback_);
+            // Timestamps may be unordered across a power-state change; use the host time then.
+            if (ticks.size() == 2 && ticks[1] >= ticks[0]) {
+                return static_cast<double>(ticks[1] - ticks[0]);
+            }
+        }
+        return hostNs;
+    }
+
+private:
+    GpuContext& ctx_;
+    wgpu::QuerySet querySet_;
+    wgpu::PassTimestampWrites writes_ = {};
+    std::size_t readback_ = 0;
+};
+
+// Nanoseconds one reduce of the first len elements of dssimQ takes: between the pass's
+// timestamps when the device has TimestampQuery, otherwise the host time from submit to
+// the completed readback.
+double TimeReduce(
+    GpuContext& ctx,
+    const ReducePipelines& reduce,
+    const wgpu::Buffer& dssimQ,
+    std::uint64_t dssimQBytes,
+    std::uint32_t len) {
+    GpuFrame frame(ctx);
+    PassTimestamps timestamps(ctx);
+    const ReduceLevel level = {.offset = 0, .len = len, .scaleLevel = 0};
+    frame.Retain(EncodeReduceLevels(ctx, frame, reduce, dssimQ, dssimQBytes, {level}, timestamps.writes()));
+    timestamps.Resolve(frame);
+    const auto start_Submit = std::chrono::steady_clock::now();
+    frame.SubmitAndWait();
+    const auto finish_Submit = std::chrono::steady_clock::now();
+    return timestamps.ElapsedNs(frame, std::chrono::duration<double, std::nano>(finish_Submit - start_Submit).count());
+}
+
+// Times every kAutotuneWorkgroupSizes x kAutotuneMaxGroups candidate of the reduce path
+// that comparisons will use (subgroup when available) on a len-element dssim map, prints
+// one [autotune] line per candidate and returns the fastest.
+ReduceTuning AutotuneReduce(GpuContext& ctx, std::uint32_t len) {
+    if (len == 0) {
+        throw std::runtime_error("autotune needs a non-empty image");
+    }
+    // Fixed pseudo-random contents, so that every candidate sees the same partition.
+    std::vector<std::uint32_t> values(len);
+    for (std::uint32_t i = 0; i < len; ++i) {
+        values[i] = (i * 2654435761u) >> 16;
+    }
+    const std::uint64_t dssimQBytes = static_cast<std::uint64_t>(len) * sizeof(std::uint32_t);
+    const PooledBuffer dssimQ =
+        ctx.bufferPool.Acquire(wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst, dssimQBytes);
+    ctx.queue.WriteBuffer(dssimQ.Get(), 0, values.data(), dssimQBytes);
+
+    const wgpu::ShaderModule& shader = ctx.subgroups ? ctx.subgroupReduceShader : ctx.reduceShader;
+    ReduceTuning best;
+    double bestNs = std::numeric_limits<double>::infinity();
+    for (const std::uint32_t workgroupSize : kAutotuneWorkgroupSizes) {
+        for (const std::uint32_t maxGroups : kAutotuneMaxGroups) {
+            const ReduceTuning tuning = {.workgroupSize = workgroupSize, .maxGroups = maxGroups};
+            const ReducePipelines reduce = CreateReducePipelines(ctx, shader, ctx.subgroups, tuning);
+            // The first submit of a pipeline pays for its lazy driver-side setup.
+            TimeReduce(ctx, reduce, dssimQ.Get(), dssimQBytes, len);
+            double ns = std::numeric_limits<double>::infinity();
+            for (std::uint32_t i = 0; i < kAutotuneRepetitions; ++i) {
+                ns = std::min(ns, TimeReduce(ctx, reduce, dssimQ.Get(), dssimQBytes, len));
+            }
+            std::cout << "[autotune] reduce=" << (ctx.subgroups ? "subgroup" : "shared")
+                      << " workgroup_size=" << workgroupSize << " max_groups=" << maxGroups << ' '
+                      << (ctx.timestampQuery ? "gpu" : "host") << "_us=" << std::fixed << std::setprecision(3)
+                      << ns / 1000.0 << '\n';
+            if (ns < bestNs) {
+                bestNs = ns;
+                best = tuning;
+            }
+        }
+    }
+    return best;
+}
+
+// Nanoseconds the stage passes of level 0 of input1/input2 take with ctx's current stage
+// pipelines: the fused dispatch, or the convert, blur and stage0 passes. With
+// TimestampQuery they are timed on the GPU from the first stage pass to the last, without
+// the reduce; otherwise on the host from submit to the completed readback, which includes
+// the same reduce for every candidate.
+double TimeStage0(GpuContext& ctx, const GpuImage& input1, const GpuImage& input2, bool fused) {
+    GpuFrame frame(ctx);
+    PassTimestamps timestamps(ctx);
+    EncodeStage0Compute(ctx, frame, ctx.reduce, input1, input2, 0, false, false, fused, timestamps.writes());
+    timestamps.Resolve(frame);
+    const auto start_Submit = std::chrono::steady_clock::now();
+    frame.SubmitAndWait();
+    const auto finish_Submit = std::chrono::steady_clock::now();
+    return timestamps.ElapsedNs(frame, std::chrono::duration<double, std::nano>(finish_Submit - start_Submit).count());
+}
+
+// Times every kAutotuneTileShapes candidate that fits the device, as the fused tile and
+// then as the Lab tile, on level 0 of image1/image2; prints one [autotune] line per
+// candidate and returns the fastest of each. Leaves ctx with the last candidate's
+// pipelines, so the caller applies the result.
+StageTuning AutotuneStages(GpuContext& ctx, const DecodedImage& image1, const DecodedImage& image2) {
+    const std::array<const DecodedImage*, 2> images = {&image1, &image2};
+    std::array<PooledBuffer, 2> pixels;
+    std::array<GpuImage, 2> inputs;
+    for (std::size_t i = 0; i < images.size(); ++i) {
+        inputs[i].width = images[i]->width;
+        inputs[i].height = images[i]->height;
+        inputs[i].format = GpuPixelFormat::Rgba8;
+        pixels[i] = ctx.bufferPool.Acquire(wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst, inputs[i].byteSize());
+        inputs[i].buffer = pixels[i].Get();
+        ctx.queue.WriteBuffer(inputs[i].buffer, 0, images[i]->pixels.data(), images[i]->pixels.size());
+    }
+
+    StageTuning best;
+    for (const bool fused : {true, false}) {
+        double bestNs = std::numeric_limits<double>::infinity();
+        for (const TileShape& tile : kAutotuneTileShapes) {
+            StageTuning tuning = best;
+            (fused ? tuning.fused : tuning.lab) = tile;
+            if (!IsAutotuneCandidate(ctx, tuning)) {
+                continue;
+            }
+            ApplyStageTuning(ctx, tuning);
+            // As in AutotuneReduce, the first submit pays for the pipelines' lazy setup.
+            TimeStage0(ctx, inputs[0], inputs[1], fused);
+            double ns = std::numeric_limits<double>::infinity();
+            for (std::uint32_t i = 0; i < kAutotuneRepetitions; ++i) {
+                ns = std::min(ns, TimeStage0(ctx, inputs[0], inputs[1], fused));
+            }
+            std::cout << "[autotune] stage=" << (fused ? "fused" : "lab") << " tile=" << tile.x << 'x' << tile.y
+                      << ' ' << (ctx.timestampQuery ? "gpu" : "host") << "_us=" << std::fixed << std::setprecision(3) << ns / 1000.0 << '\n';
+            if (ns < bestNs) {
+                bestNs = ns;
+                best = tuning;
+            }
+        }
+    }
+    return best;
+}
+
+// Accumulated per-phase timings, printed as the [profiling] lines.
+struct ProfilingTotals {
+    milliseconds createShaderModule{0};
+    milliseconds createPSO{0};
+    milliseconds createPipelineLayouts{0};
+    milliseconds createBuffers{0};
+    milliseconds writeInputBuffers{0};
+    milliseconds createBindGroups{0};
+    milliseconds dispatchAndSubmit{0};
+    milliseconds readback{0};
+    milliseconds postProcess{0};
+    // --backend cpu: the whole CpuCompare call.
+    milliseconds cpuCompute{0};
+};
+
+struct ComparisonOutputs {
+    MultiScaleOutputs compute;
+    // Level 1 of each pyramid; only read back for debug dumps.
+    std::vector<LinearRgba> firstDownsample1;
+    std::vector<LinearRgba> firstDownsample2;
+};
+
+// Pyramid levels below level 0 that are scored: a level is downsampled unless it is the
+// last one or smaller than 8 pixels on a side.
+std::uint32_t DownsampleCount(std::uint32_t width, std::uint32_t height) {
+    std::uint32_t count = 0;
+    for (std::uint32_t w = width, h = height; count + 1 < kDefaultScaleWeights.size() && w >= 8 && h >= 8;
+         w /= 2u, h /= 2u) {
+        ++count;
+    }
+    return count;
+}
+
+// Weighted MS-SSIM over compute.scales and the final dssim score.
+void AggregateScales(MultiScaleOutputs& compute) {
+    double weightedSum = 0.0;
+    double weightTotal = 0.0;
+    for (std::size_t i = 0; i < compute.scales.size(); ++i) {
+        const double w = kDefaultScaleWeights[i];
+        weightedSum += compute.scales[i].ssimScore * w;
+        weightTotal += w;
+    }
+    compute.weightedSsim = weightedSum / weightTotal;
+    compute.score = 1.0 / std::max(compute.weightedSsim, std::numeric_limits<double>::epsilon()) - 1.0;
+}
+
+// Reads every pending level's LevelStatsData after frame.SubmitAndWait(). sum_final derives
+// its threshold in f32, which can land next to floor(t) of the host's double t; those levels
+// are partitioned again at DssimDeviationThreshold, all in one more submit over the maps the
+// frame kept, so that ScoreScale's split is exact.
+std::vector<LevelStatsData> ResolveLevelStats(
+    GpuContext& ctx,
+    const ReducePipelines& reduce,
+    const GpuFrame& frame,
+    const std::vector<Stage0Pending>& pendings,
+    ProfilingTotals& profiling) {
+    std::vector<LevelStatsData> resolved;
+    std::vector<std::size_t> misplaced;
+    for (const Stage0Pending& pending : pendings) {
+        const std::vector<LevelStatsData> levelStats = frame.ReadbackAs<LevelStatsData>(pending.levelStatsReadback);
+        if (levelStats.size() <= pending.levelStatsIndex) {
+            throw std::runtime_error("missing reduced level stats");
+        }
+        LevelStatsData stats = levelStats[pending.levelStatsIndex];
+        const std::uint32_t exact = DssimDeviationThreshold(
+            stats.sum, pending.reduceLevel.len, kStage0QScale, static_cast<std::uint32_t>(pending.scaleLevel));
+        if (stats.threshold != exact) {
+            stats.threshold = exact;
+            misplaced.push_back(resolved.size());
+        }
+        resolved.push_back(stats);
+    }
+    if (misplaced.empty()) {
+        return resolved;
+    }
+    GpuFrame partitionFrame(ctx);
+    std::vector<std::size_t> handles;
+    for (const std::size_t i : misplaced) {
+        const Stage0Pending& pending = pendings[i];
+        PooledBuffer levelStatsPooled = EncodeReduceLevels(
+            ctx, partitionFrame, reduce, pending.dssimQ, pending.dssimQBytes, {pending.reduceLevel}, nullptr,
+            {resolved[i].threshold});
+        handles.push_back(partitionFrame.ScheduleReadback(std::move(levelStatsPooled), sizeof(LevelStatsData)));
+    }
+    partitionFrame.SubmitAndWait();
+    profiling.dispatchAndSubmit += partitionFrame.submit_time;
+    profiling.readback += partitionFrame.readback_time;
+    for (std::size_t k = 0; k < misplaced.size(); ++k) {
+        const LevelStatsData stats = partitionFrame.ReadbackAs<LevelStatsData>(handles[k]).at(0);
+        resolved[misplaced[k]].hiCount = stats.hiCount;
+        resolved[misplaced[k]].hiSum = stats.hiSum;
+    }
+    return resolved;
+}
+
+// Uploads both decoded images and scores them over every scale level in one submit, plus
+// the partition submit of ResolveLevelStats when a level needs it.
+// subgroupReduce selects ctx.subgroupReduce for the SSIM map reductions. The score always
+// comes from the fused kernels; debug dumps add an unfused pass over levels 0 and 1 in the
+// same submit for the planes they write, checked against the fused level-0 map.
+ComparisonOutputs RunComparison(
+    GpuContext& ctx,
+    const DecodedImage& image1,
+    const DecodedImage& image2,
+    bool textureInput,
+    bool debugDumpEnabled,
+    std::uint32_t levelBatchPixels,
+    bool subgroupReduce,
+    ProfilingTotals& profiling) {
+    const ReducePipelines& reduce = subgroupReduce ? ctx.subgroupReduce : ctx.reduce;
+    ComparisonOutputs outputs;
+    MultiScaleOutputs& compute = outputs.compute;
+
+    // Level 0 is the only image uploaded, as the decoder's packed RGBA8 bytes; every
+    // further level is produced and consumed on the GPU.
+    if ((image1.pixels.size() % 4) != 0 || (image2.pixels.size() % 4) != 0) {
+        throw std::runtime_error("rgba8 byte count is not divisible by 4");
+    }
+    const std::uint32_t downsampleCount = DownsampleCount(image1.width, image1.height);
+    // Every level is recorded into one command buffer; the host waits once, for the
+    // combined readback, after the whole pyramid has been submitted.
+    GpuFrame frame(ctx);
+    const auto start_CreateInputBuffers = std::chrono::steady_clock::now();
+    GpuImage input1;
+    GpuImage input2;
+    std::chrono::steady_clock::time_point start_UploadInputs;
+    if (textureInput) {
+        start_UploadInputs = std::chrono::steady_clock::now();
+        input1 = UploadTextureImage(ctx, image1);
+        input2 = UploadTextureImage(ctx, image2);
+    } else {
+        input1 = AcquireGpuImage(ctx, frame, image1.width, image1.height, GpuPixelFormat::Rgba8);
+        input2 = AcquireGpuImage(ctx, frame, image2.width, image2.height, GpuPixelFormat::Rgba8);
+        start_UploadInputs = std::chrono::steady_clock::now();
+        ctx.queue.WriteBuffer(input1.buffer, 0, image1.pixels.data(), image1.pixels.size());
+        ctx.queue.WriteBuffer(input2.buffer, 0, image2.pixels.data(), image2.pixels.size());
+    }
+    const auto finish_UploadInputs = std::chrono::steady_clock::now();
+    profiling.createBuffers += duration_cast<milliseconds>(start_UploadInputs - start_CreateInputBuffers);
+    profiling.writeInputBuffers += duration_cast<milliseconds>(finish_UploadInputs - start_UploadInputs);
+
+    // The whole pyramid comes out of one dispatch, recorded ahead of the stage0 levels.
+    DownsampleOutputs pyramid;
+    if (downsampleCount > 0) {
+        pyramid = EncodeDownsamplePyramid(ctx, frame, input1, input2, downsampleCount, debugDumpEnabled);
+        profiling.createBuffers += pyramid.createBuffers_time;
+        profiling.writeInputBuffers += pyramid.writeInputBuffers_time;
+        profiling.createBindGroups += pyramid.createBindGroups_time;
+        profiling.dispatchAndSubmit += pyramid.dispatchAndSubmit_time;
+    }
+
+    // Levels batchStart..downsampleCount are scored by one batched dispatch: the trailing
+    // run of levels under levelBatchPixels whose tiles fit one dispatch dimension. Level 0
+    // (packed RGBA8 input) is never batched.
+    std::size_t batchStart = downsampleCount + 1;
+    if (levelBatchPixels > 0) {
+        std::uint64_t batchTiles = 0;
+        while (batchStart > 1) {
+            const GpuImage& image = pyramid.levels[batchStart - 2][0];
+            const std::uint64_t tiles = FusedTileCount(image.width, image.height, ctx.stageTuning.fused);
+            if (image.pixelCount() >= levelBatchPixels || batchTiles + tiles > kMaxWorkgroupsPerDimension) {
+                break;
+            }
+            batchTiles += tiles;
+            --batchStart;
+        }
+        // A batch of one level is just the per-level path.
+        if (batchStart == downsampleCount) {
+            batchStart = downsampleCount + 1;
+        }
+    }
+
+    std::vector<Stage0Pending> pendingScales;
+    for (std::size_t level = 0; level < batchStart; ++level) {
+        const GpuImage& curr1 = (level == 0) ? input1 : pyramid.levels[level - 1][0];
+        const GpuImage& curr2 = (level == 0) ? input2 : pyramid.levels[level - 1][1];
+        // The fused level-0 map is only read back to check the debug-dump pass below.
+        const bool readDssimMap = debugDumpEnabled && level == 0;
+        Stage0Pending pending =
+            EncodeStage0Compute(ctx, frame, reduce, curr1, curr2, level, readDssimMap, false, true);
+        profiling.createBuffers += pending.createBuffers_time;
+        profiling.writeInputBuffers += pending.writeInputBuffers_time;
+        profiling.createBindGroups += pending.createBindGroups_time;
+        profiling.dispatchAndSubmit += pending.dispatchAndSubmit_time;
+        pendingScales.push_back(pending);
+    }
+    if (batchStart <= downsampleCount) {
+        for (const Stage0Pending& pending : EncodeStage0Batch(ctx, frame, reduce, pyramid, batchStart, downsampleCount)) {
+            profiling.createBuffers += pending.createBuffers_time;
+            profiling.writeInputBuffers += pending.writeInputBuffers_time;
+            profiling.createBindGroups += pending.createBindGroups_time;
+            profiling.dispatchAndSubmit += pending.dispatchAndSubmit_time;
+            pendingScales.push_back(pending);
+        }
+    }
+    // Debug dumps need the Lab and moment planes the fused shader never materializes, so
+    // levels 0 (planes and map) and 1 (map) also go through convert -> blur -> stage0. Only
+    // their planes are read; their reduce is never looked at.
+    std::vector<Stage0Pending> dumpScales;
+    if (debugDumpEnabled) {
+        for (std::size_t level = 0; level <= std::min<std::size_t>(downsampleCount, 1); ++level) {
+            const GpuImage& curr1 = (level == 0) ? input1 : pyramid.levels[level - 1][0];
+            const GpuImage& curr2 = (level == 0) ? input2 : pyramid.levels[level - 1][1];
+            const Stage0Pending pending =
+                EncodeStage0Compute(ctx, frame, reduce, curr1, curr2, level, true, level == 0, false);
+            profiling.createBuffers += pending.createBuffers_time;
+            profiling.writeInputBuffers += pending.writeInputBuffers_time;
+            profiling.createBindGroups += pending.createBindGroups_time;
+            profiling.dispatchAndSubmit += pending.dispatchAndSubmit_time;
+            dumpScales.push_back(pending);
+        }
+    }
+
+    frame.SubmitAndWait();
+    profiling.dispatchAndSubmit += frame.submit_time;
+    profiling.readback += frame.readback_time;
+    const std::vector<LevelStatsData> levelStats = ResolveLevelStats(ctx, reduce, frame, pendingScales, profiling);
+    for (std::size_t i = 0; i < pendingScales.size(); ++i) {
+        const Stage0Pending& pending = pendingScales[i];
+        ScaleOutputs scale = FinishStage0Compute(frame, pending, levelStats[i]);
+        profiling.readback += scale.readback_time;
+        profiling.postProcess += scale.postProcess_time;
+        compute.scales.push_back(std::move(scale));
+    }
+    for (std::size_t level = 0; level < dumpScales.size(); ++level) {
+        ScaleOutputs& scale = compute.scales[level];
+        ScaleOutputs planes;
+        ReadStage0Planes(frame, dumpScales[level], planes);
+        if (level == 0 && planes.dssimQ != scale.dssimQ) {
+            throw std::runtime_error("fused and unfused stage0 kernels disagree on the level-0 dssim map");
+        }
+        scale.dssimQ = std::move(planes.dssimQ);
+        scale.mu1 = std::move(planes.mu1);
+        scale.mu2 = std::move(planes.mu2);
+        scale.var1 = std::move(planes.var1);
+        scale.var2 = std::move(planes.var2);
+        scale.cov12 = std::move(planes.cov12);
+    }
+    if (pyramid.hasPixelsReadback) {
+        outputs.firstDownsample1 = ReadDownsamplePixels(frame, pyramid, 0);
+        outputs.firstDownsample2 = ReadDownsamplePixels(frame, pyramid, 1);
+    }
+
+    AggregateScales(compute);
+    return outputs;
+}
+
+// RunComparison on the CPU engine: the same levels, scores and debug planes, computed by
+// CpuCompare with `kernels` on `pool`.
+ComparisonOutputs RunCpuComparison(
+    const CpuKernels& kernels,
+    const DecodedImage& image1,
+    const DecodedImage& image2,
+    bool debugDumpEnabled,
+    ThreadPool& pool,
+    ProfilingTotals& profiling) {
+    ComparisonOutputs outputs;
+    MultiScaleOutputs& compute = outputs.compute;
+    const CpuCompareOptions cpuOptions = {
+        .levelCount = DownsampleCount(image1.width, image1.height) + 1u,
+        .qscale = kStage0QScale,
+        .debugDump = debugDumpEnabled,
+    };
+    const auto start_Compute = std::chrono::steady_clock::now();
+    CpuCompareOutputs cpu = CpuCompare(kernels, image1, image2, cpuOptions, pool);
+    const auto finish_Compute = std::chrono::steady_clock::now();
+    profiling.cpuCompute += duration_cast<milliseconds>(finish_Compute - start_Compute);
+
+    const auto start_PostProcess = std::chrono::steady_clock::now();
+    for (std::size_t level = 0; level < cpu.levels.size(); ++level) {
+        CpuLevelOutputs& cpuLevel = cpu.levels[level];
+        ScaleOutputs scale;
+        scale.width = cpuLevel.width;
+        scale.height = cpuLevel.height;
+        scale.dssimQ = std::move(cpuLevel.dssimQ);
+        scale.mu1 = std::move(cpuLevel.mu1);
+        scale.mu2 = std::move(cpuLevel.mu2);
+        scale.var1 = std::move(cpuLevel.var1);
+        scale.var2 = std::move(cpuLevel.var2);
+        scale.cov12 = std::move(cpuLevel.cov12);
+        ScoreScale(scale, cpuLevel.stats.sum, cpuLevel.stats.threshold, cpuLevel.stats.hiCount,
+                   cpuLevel.stats.hiSum, static_cast<std::uint32_t>(level));
+        compute.scales.push_back(std::move(scale));
+    }
+    const auto toLinearRgba = [](const std::vector<float>& rgba) {
+        std::vector<LinearRgba> pixels(rgba.size() / 4u);
+        for (std::size_t i = 0; i < pixels.size(); ++i) {
+            pixels[i] = {.r = rgba[i * 4u], .g = rgba[i * 4u + 1u], .b = rgba[i * 4u + 2u], .a = rgba[i * 4u + 3u]};
+        }
+        return pixels;
+    };
+    outputs.firstDownsample1 = toLinearRgba(cpu.firstDownsample[0]);
+    outputs.firstDownsample2 = toLinearRgba(cpu.firstDownsample[1]);
+    AggregateScales(compute);
+    const auto finish_PostProcess = std::chrono::steady_clock::now();
+    profiling.postProcess += duration_cast<milliseconds>(finish_PostProcess - start_PostProcess);
+    return outputs;
+}
+
+struct BenchmarkTiming {
+    double meanMs = 0.0;
+    double minMs = 0.0;
+};
+
+// Wall time of `iterations` calls of run(), which returns ComparisonOutputs. Every call must
+// reproduce expectedScore, or the first call's score when none is given.
+template <class Run>
+BenchmarkTiming TimeComparisons(std::uint32_t iterations, std::optional<double> expectedScore, Run run) {
+    double totalMs = 0.0;
+    double minMs = std::numeric_limits<double>::infinity();
+    for (std::uint32_t i = 0; i < iterations; ++i) {
+        const auto start_Iteration = std::chrono::steady_clock::now();
+        const ComparisonOutputs iteration = run();
+        const auto finish_Iteration = std::chrono::steady_clock::now();
+        if (!expectedScore) {
+            expectedScore = iteration.compute.score;
+        }
+        if (iteration.compute.score != *expectedScore) {
+            throw std::runtime_error("benchmark iteration produced a different score");
+        }
+        const double ms = std::chrono::duration<double, std::milli>(finish_Iteration - start_Iteration).count();
+        totalMs += ms;
+        minMs = std::min(minMs, ms);
+    }
+    return {.meanMs = totalMs / iterations, .minMs = minMs};
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
     try {
         const CliOptions options = ParseArgs(argc, argv);
-        const auto stage0ShaderPath = ResolveShaderPath(argv[0], "stage0_absdiff.wgsl");
-        const auto downsampleShaderPath = ResolveShaderPath(argv[0], "downsample_2x2.wgsl");
-        const auto labPreprocessShaderPath = ResolveShaderPath(argv[0], "lab_preprocess.wgsl");
-        const auto stage0ShaderSource = ReadAllText(stage0ShaderPath);
-        const auto downsampleShaderSource = ReadAllText(downsampleShaderPath);
-        const auto labPreprocessShaderSource = ReadAllText(labPreprocessShaderPath);
+        // The CPU backend needs no shaders, so it also runs from a bare binary.
+        ShaderSources shaderSources;
+        if (!options.cpuBackend) {
+            shaderSources.common = ReadAllText(ResolveShaderPath(argv[0], "dssim_common.wgsl"));
+            shaderSources.stage0 = ReadAllText(ResolveShaderPath(argv[0], "stage0_absdiff.wgsl"));
+            shaderSources.fused = ReadAllText(ResolveShaderPath(argv[0], "ssim_fused.wgsl"));
+            shaderSources.downsample = ReadAllText(ResolveShaderPath(argv[0], "downsample_pyramid.wgsl"));
+            shaderSources.preprocess = ReadAllText(ResolveShaderPath(argv[0], "lab_preprocess.wgsl"));
+            shaderSources.reduce = ReadAllText(ResolveShaderPath(argv[0], "ssim_reduce.wgsl"));
+            shaderSources.reduceSubgroups = ReadAllText(ResolveShaderPath(argv[0], "ssim_reduce_subgroups.wgsl"));
+        }
         const DecodedImage image1 = LoadPngRgba8(options.image1);
         const DecodedImage image2 = LoadPngRgba8(options.image2);
         if (image1.pixels.empty() || image2.pixels.empty()) {
@@ -1306,120 +3045,71 @@ int main(int argc, char** argv) {
             .byteCount = image2.pixels.size(),
         };
 
-        const auto input1 = ConvertRgba8ToLinearPlu(image1.pixels);
-        const auto input2 = ConvertRgba8ToLinearPlu(image2.pixels);
-
-        dawnProcSetProcs(&dawn::native::GetProcs());
-
-        wgpu::Instance instance = wgpu::CreateInstance();
-        if (!instance) {
-            throw std::runtime_error("failed to create WGPU instance");
+        // A GPU benchmark with --bench-cpu also times the CPU engine.
+        const bool benchCpu = options.benchIterations > 0 && (options.cpuBackend || options.benchCpu);
+        const CpuKernels* cpuKernels = nullptr;
+        if (options.cpuBackend || benchCpu) {
+            cpuKernels = &SelectCpuKernels(options.cpuIsa);
         }
 
-        wgpu::Adapter adapter = RequestAdapterBlocking(instance);
-        wgpu::Device device = RequestDeviceBlocking(instance, adapter);
-
-        std::string adapterName = "unknown";
-        wgpu::AdapterInfo adapterInfo;
-        if (adapter.GetInfo(&adapterInfo)) {
-            const std::string_view description = static_cast<std::string_view>(adapterInfo.description);
-            const std::string_view deviceName = static_cast<std::string_view>(adapterInfo.device);
-            if (!description.empty()) {
-                adapterName = std::string(description);
-            } else if (!deviceName.empty()) {
-                adapterName = std::string(deviceName);
-            }
-        }
-
-        MultiScaleOutputs compute;
-        std::vector<LinearRgba> curr1 = input1;
-        std::vector<LinearRgba> curr2 = input2;
-        std::uint32_t currWidth = image1.width;
-        std::uint32_t currHeight = image1.height;
-
-        DownsampleOutputs firstDownsample1;
-        DownsampleOutputs firstDownsample2;
-
-        milliseconds createShaderModuleProcessingTime{0};
-        milliseconds createPSOProcessingTime{0};
-        milliseconds createBuffersProcessingTime{0};
-        milliseconds writeInputBuffersProcessingTime{0};
-        milliseconds createPipelineLayoutsProcessingTime{0};
-        milliseconds createBindGroupsProcessingTime{0};
-        milliseconds dispatchAndSubmitProcessingTime{0};
-        milliseconds readbackProcessingTime{0};
-        milliseconds postProcessProcessingTime{0};
-        for (std::size_t level = 0; level < kDefaultScaleWeights.size(); ++level) {
-            const bool readStats = options.debugDumpEnabled && level == 0;
-            ScaleOutputs scale = RunStage0Compute(
-                instance,
-                device,
-                curr1,
-                curr2,
-                currWidth,
-                currHeight,
-                level,
-                readStats,
-                labPreprocessShaderSource,
-                stage0ShaderSource);
-            createShaderModuleProcessingTime += scale.createShaderModule_time;
-            createPSOProcessingTime += scale.createPSO_time;
-            createBuffersProcessingTime += scale.createBuffers_time;
-            writeInputBuffersProcessingTime += scale.writeInputBuffers_time;
-            createPipelineLayoutsProcessingTime += scale.createPipelineLayouts_time;
-            createBindGroupsProcessingTime += scale.createBindGroups_time;
-            dispatchAndSubmitProcessingTime += scale.dispatchAndSubmit_time;
-            readbackProcessingTime += scale.readback_time;
-            postProcessProcessingTime += scale.postProcess_time;
-            compute.scales.push_back(std::move(scale));
-            if (level + 1 >= kDefaultScaleWeights.size()) {
-                break;
-            }
-            if (currWidth < 8 || currHeight < 8) {
-                break;
-            }
-
-            DownsampleOutputs next1 = RunDownsample2x2Compute(
-                instance,
-                device,
-                curr1,
-                currWidth,
-                currHeight,
-                downsampleShaderSource);
-            DownsampleOutputs next2 = RunDownsample2x2Compute(
-                instance,
-                device,
-                curr2,
-                currWidth,
-                currHeight,
-                downsampleShaderSource);
-            createShaderModuleProcessingTime += next1.createShaderModule_time + next2.createShaderModule_time;
-            createPSOProcessingTime += next1.createPSO_time + next2.createPSO_time;
-            createBuffersProcessingTime += next1.createBuffers_time + next2.createBuffers_time;
-            writeInputBuffersProcessingTime += next1.writeInputBuffers_time + next2.writeInputBuffers_time;
-            createPipelineLayoutsProcessingTime += next1.createPipelineLayouts_time + next2.createPipelineLayouts_time;
-            createBindGroupsProcessingTime += next1.createBindGroups_time + next2.createBindGroups_time;
-            dispatchAndSubmitProcessingTime += next1.dispatchAndSubmit_time + next2.dispatchAndSubmit_time;
-            readbackProcessingTime += next1.readback_time + next2.readback_time;
-            if (level == 0) {
-                firstDownsample1 = next1;
-                firstDownsample2 = next2;
+        // Shared by the CPU engine and the host-side loops (debug dump conversion).
+        ThreadPool pool(options.threads != 0 ? options.threads : DefaultThreadCount());
+
+        ProfilingTotals profiling;
+        std::optional<GpuContext> gpu;
+        ComparisonOutputs comparison;
+        std::string adapterName;
+        bool labF16 = false;
+        if (options.cpuBackend) {
+            adapterName = std::string("cpu (") + cpuKernels->isa + ")";
+            comparison = RunCpuComparison(*cpuKernels, image1, image2, options.debugDumpEnabled, pool, profiling);
+        } else {
+            GpuContext& ctx = gpu.emplace(CreateGpuContext(shaderSources, options));
+            adapterName = ctx.adapterName;
+            labF16 = ctx.labF16;
+            profiling.createShaderModule = ctx.createShaderModule_time;
+            profiling.createPSO = ctx.createPSO_time;
+            profiling.createPipelineLayouts = ctx.createPipelineLayouts_time;
+
+            // Reduce launch configuration and stage tiles: measured now with --autotune,
+            // otherwise whatever an earlier --autotune stored for this adapter, otherwise the
+            // shader defaults.
+            const std::filesystem::path autotuneCachePath =
+                options.autotuneCache.empty() ? DefaultAutotuneCachePath() : options.autotuneCache;
+            const std::string reducePath = ctx.subgroups ? "subgroup" : "shared";
+            if (options.autotune) {
+                const AutotuneResult tuning = {
+                    .reduce = AutotuneReduce(ctx, image1.width * image1.height),
+                    .stage = AutotuneStages(ctx, image1, image2),
+                };
+                ApplyReduceTuning(ctx, tuning.reduce);
+                ApplyStageTuning(ctx, tuning.stage);
+                std::cout << "[autotune] selected workgroup_size=" << tuning.reduce.workgroupSize
+                          << " max_groups=" << tuning.reduce.maxGroups << " fused_tile=" << tuning.stage.fused.x
+                          << 'x' << tuning.stage.fused.y << " lab_tile=" << tuning.stage.lab.x << 'x'
+                          << tuning.stage.lab.y << '\n';
+                if (autotuneCachePath.empty()) {
+                    std::cerr << "dssim_gpu_dawn_checksum: no autotune cache location; result not saved\n";
+                } else {
+                    AutotuneCache cache = AutotuneCache::Load(autotuneCachePath);
+                    cache.Store(ctx.adapterKey, reducePath, tuning);
+                    cache.Save();
+                }
+            } else if (!autotuneCachePath.empty()) {
+                const std::optional<AutotuneResult> tuning =
+                    AutotuneCache::Load(autotuneCachePath).Find(ctx.adapterKey, reducePath);
+                if (tuning && IsAutotuneCandidate(tuning->reduce) && IsAutotuneCandidate(ctx, tuning->stage)) {
+                    ApplyReduceTuning(ctx, tuning->reduce);
+                    ApplyStageTuning(ctx, tuning->stage);
+                }
             }
-            currWidth = next1.width;
-            currHeight = next1.height;
-            curr1 = std::move(next1.pixels);
-            curr2 = std::move(next2.pixels);
-        }
-
-        double weightedSum = 0.0;
-        double weightTotal = 0.0;
-        for (std::size_t i = 0; i < compute.scales.size(); ++i) {
-            const double w = kDefaultScaleWeights[i];
-            weightedSum += compute.scales[i].ssimScore * w;
-            weightTotal += w;
+            comparison =
+                RunComparison(ctx, image1, image2, options.textureInput, options.debugDumpEnabled,
+                              options.levelBatchPixels, ctx.subgroups, profiling);
         }
-        compute.weightedSsim = weightedSum / weightTotal;
-        compute.score = 1.0 / std::max(compute.weightedSsim, std::numeric_limits<double>::epsilon()) - 1.0;
+        const MultiScaleOutputs& compute = comparison.compute;
+        const std::vector<LinearRgba>& firstDownsample1 = comparison.firstDownsample1;
+        const std::vector<LinearRgba>& firstDownsample2 = comparison.firstDownsample2;
 
         DebugDumpInfo debugInfo;
         DebugDumpInfo* debugInfoPtr = nullptr;
@@ -1433,7 +3123,7 @@ int main(int argc, char** argv) {
             debugInfo.stage0Var1Path = options.debugDumpDir / "stage0_var1_f32le.gpu.bin";
             debugInfo.stage0Var2Path = options.debugDumpDir / "stage0_var2_f32le.gpu.bin";
             debugInfo.stage0Cov12Path = options.debugDumpDir / "stage0_cov12_f32le.gpu.bin";
-            debugInfo.stage0ElemCount = compute.scales.empty() ? 0 : compute.scales[0].dssimQ.size();
+            debugInfo.stage0ElemCount = compute.scales.empty() ? 0 : compute.scales[0].elemCount;
             WriteU8Buffer(debugInfo.image1RgbaPath, image1.pixels);
             WriteU8Buffer(debugInfo.image2RgbaPath, image2.pixels);
             WriteU32LeBuffer(debugInfo.stage0DssimPath, compute.scales[0].dssimQ);
@@ -1442,20 +3132,20 @@ int main(int argc, char** argv) {
             WriteF32LeBuffer(debugInfo.stage0Var1Path, compute.scales[0].var1);
             WriteF32LeBuffer(debugInfo.stage0Var2Path, compute.scales[0].var2);
             WriteF32LeBuffer(debugInfo.stage0Cov12Path, compute.scales[0].cov12);
-            if (compute.scales.size() > 1 && !firstDownsample1.pixels.empty() && !firstDownsample2.pixels.empty()) {
+            if (compute.scales.size() > 1 && !firstDownsample1.empty() && !firstDownsample2.empty()) {
                 debugInfo.image1Scale1Path = options.debugDumpDir / "image1_scale1_rgba8.gpu.bin";
                 debugInfo.image2Scale1Path = options.debugDumpDir / "image2_scale1_rgba8.gpu.bin";
                 debugInfo.stage1DssimPath = options.debugDumpDir / "stage1_dssim5x5_gaussian_linear_u32le.gpu.bin";
-                debugInfo.stage1ElemCount = compute.scales[1].dssimQ.size();
-                WriteU8Buffer(debugInfo.image1Scale1Path, ConvertLinearPluToRgba8(firstDownsample1.pixels));
-                WriteU8Buffer(debugInfo.image2Scale1Path, ConvertLinearPluToRgba8(firstDownsample2.pixels));
+                debugInfo.stage1ElemCount = compute.scales[1].elemCount;
+                WriteU8Buffer(debugInfo.image1Scale1Path, ConvertLinearPluToRgba8(firstDownsample1, pool));
+                WriteU8Buffer(debugInfo.image2Scale1Path, ConvertLinearPluToRgba8(firstDownsample2, pool));
                 WriteU32LeBuffer(debugInfo.stage1DssimPath, compute.scales[1].dssimQ);
             }
             debugInfoPtr = &debugInfo;
         }
 
         if (!options.out.empty()) {
-            const std::string json = BuildJson(options, adapterName, decoded1, decoded2, compute, debugInfoPtr);
+            const std::string json = BuildJson(options, adapterName, labF16, decoded1, decoded2, compute, debugInfoPtr);
             WriteStringFile(options.out, json);
         }
 
@@ -1465,24 +3155,74 @@ int main(int argc, char** argv) {
         const auto scoreReadyAt = std::chrono::steady_clock::now();
         const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(scoreReadyAt - decodeDoneAt).count();
         std::cout << "[profiling] decode_done_to_score_ms = " << elapsedMs << '\n';
-        std::cout << "[profiling] CreateShaderModule processing time = "
-                  << createShaderModuleProcessingTime.count() << "ms\n";
-        std::cout << "[profiling] CreatePSO processing time = "
-        << createPSOProcessingTime.count() << "ms\n";
-        std::cout << "[profiling] CreateBuffer processing time = "
-                  << createBuffersProcessingTime.count() << "ms\n";
-        std::cout << "[profiling] WriteInputBuffer processing time = "
-                  << writeInputBuffersProcessingTime.count() << "ms\n";
-        std::cout << "[profiling] CreatePipelineLayout processing time = "
-                  << createPipelineLayoutsProcessingTime.count() << "ms\n";
-        std::cout << "[profiling] CreateBindGroup processing time = "
-                  << createBindGroupsProcessingTime.count() << "ms\n";
-        std::cout << "[profiling] DispatchAndSubmit processing time = "
-                  << dispatchAndSubmitProcessingTime.count() << "ms\n";
-        std::cout << "[profiling] Readback processing time = "
-                  << readbackProcessingTime.count() << "ms\n";
-        std::cout << "[profiling] PostProcess processing time = "
-                  << postProcessProcessingTime.count() << "ms\n";
+        if (options.cpuBackend) {
+            std::cout << "[profiling] CpuCompute threads = " << pool.threadCount() << "\n";
+            std::cout << "[profiling] CpuCompute processing time = " << profiling.cpuCompute.count() << "ms\n";
+            std::cout << "[profiling] PostProcess processing time = " << profiling.postProcess.count() << "ms\n";
+        } else {
+            const GpuContext& ctx = *gpu;
+            std::cout << "[profiling] CreateShaderModule processing time = "
+                      << profiling.createShaderModule.count() << "ms\n";
+            std::cout << "[profiling] CreatePSO processing time = "
+            << profiling.createPSO.count() << "ms\n";
+            std::cout << "[profiling] CreateBuffer processing time = "
+                      << profiling.createBuffers.count() << "ms\n";
+            std::cout << "[profiling] GpuBufferPool allocations = " << ctx.bufferPool.allocationCount()
+                      << " (" << ctx.bufferPool.allocatedBytes() << " bytes), reuses = "
+                      << ctx.bufferPool.reuseCount() << "\n";
+            std::cout << "[profiling] WriteInputBuffer processing time = "
+                      << profiling.writeInputBuffers.count() << "ms\n";
+            std::cout << "[profiling] CreatePipelineLayout processing time = "
+                      << profiling.createPipelineLayouts.count() << "ms\n";
+            std::cout << "[profiling] CreateBindGroup processing time = "
+                      << profiling.createBindGroups.count() << "ms\n";
+            std::cout << "[profiling] DispatchAndSubmit processing time = "
+                      << profiling.dispatchAndSubmit.count() << "ms\n";
+            std::cout << "[profiling] Readback processing time = "
+                      << profiling.readback.count() << "ms\n";
+            std::cout << "[profiling] PostProcess processing time = "
+                      << profiling.postProcess.count() << "ms\n";
+        }
+
+        if (options.benchIterations > 0) {
+            // Steady-state timing of whole comparisons (upload to score) with warm pipelines
+            // and buffer pool; debug readbacks are never part of the measurement. Both input
+            // paths and every reduce path the device supports are timed on the same device,
+            // each combination on its own line, followed by the CPU engine on the same inputs
+            // for --backend cpu or --bench-cpu.
+            if (gpu) {
+                GpuContext& ctx = *gpu;
+                std::vector<bool> reducePaths = {false};
+                if (ctx.subgroups) {
+                    reducePaths.push_back(true);
+                }
+                for (const bool textureInput : {false, true}) {
+                    for (const bool subgroupReduce : reducePaths) {
+                        ProfilingTotals benchProfiling;
+                        const BenchmarkTiming timing = TimeComparisons(options.benchIterations, compute.score, [&]() {
+                            return RunComparison(ctx, image1, image2, textureInput, false, options.levelBatchPixels,
+                                                 subgroupReduce, benchProfiling);
+                        });
+                        std::cout << "[benchmark] input_path=" << (textureInput ? "texture" : "buffer")
+                                  << " reduce=" << (subgroupReduce ? "subgroup" : "shared")
+                                  << " iterations=" << options.benchIterations << std::fixed << std::setprecision(3)
+                                  << " mean_ms=" << timing.meanMs << " min_ms=" << timing.minMs << '\n';
+                    }
+                }
+            }
+            if (benchCpu) {
+                // The CPU score only has to match the main run when that was the CPU too.
+                ProfilingTotals benchProfiling;
+                const std::optional<double> cpuScore =
+                    options.cpuBackend ? std::optional<double>(compute.score) : std::nullopt;
+                const BenchmarkTiming timing = TimeComparisons(options.benchIterations, cpuScore, [&]() {
+                    return RunCpuComparison(*cpuKernels, image1, image2, false, pool, benchProfiling);
+                });
+                std::cout << "[benchmark] backend=cpu isa=" << cpuKernels->isa << " threads=" << pool.threadCount()
+                          << " iterations=" << options.benchIterations << std::fixed << std::setprecision(3)
+                          << " mean_ms=" << timing.meanMs << " min_ms=" << timing.minMs << '\n';
+            }
+        }
         return 0;
     } catch (const std::exception& ex) {
         std::cerr << "dssim_gpu_dawn_checksum error: " << ex.what() << '\n';
@@ -0,0 +1,105 @@
+#include "dssim_histogram.h"
+
+DssimHistogram::DssimHistogram() : pages_(kFineLimit / kPageSize) {}
+
+void DssimHistogram::AddRow(const std::uint32_t* values, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        const std::uint32_t v = values[i];
+        sum_ += v;
+        if (v >= kFineLimit) {
+            if (coarse_.empty()) {
+                coarse_.resize(kCoarseBuckets);
+            }
+            Bucket& bucket = coarse_[v >> kFineBits];
+            ++bucket.count;
+            bucket.sum += v;
+            ++coarseCount_;
+            coarseSum_ += v;
+            continue;
+        }
+        std::unique_ptr<std::uint32_t[]>& page = pages_[v >> kPageBits];
+        if (page == nullptr) {
+            page = std::make_unique<std::uint32_t[]>(kPageSize);
+        }
+        ++page[v & (kPageSize - 1u)];
+    }
+    count_ += n;
+}
+
+void DssimHistogram::Merge(const DssimHistogram& other) {
+    for (std::size_t p = 0; p < pages_.size(); ++p) {
+        const std::uint32_t* from = other.pages_[p].get();
+        if (from == nullptr) {
+            continue;
+        }
+        std::unique_ptr<std::uint32_t[]>& page = pages_[p];
+        if (page == nullptr) {
+            page = std::make_unique<std::uint32_t[]>(kPageSize);
+        }
+        for (std::uint32_t i = 0; i < kPageSize; ++i) {
+            page[i] += from[i];
+        }
+    }
+    if (!other.coarse_.empty()) {
+        if (coarse_.empty()) {
+            coarse_.resize(kCoarseBuckets);
+        }
+        for (std::uint32_t b = 0; b < kCoarseBuckets; ++b) {
+            coarse_[b].count += other.coarse_[b].count;
+            coarse_[b].sum += other.coarse_[b].sum;
+        }
+    }
+    coarseCount_ += other.coarseCount_;
+    coarseSum_ += other.coarseSum_;
+    count_ += other.count_;
+    sum_ += other.sum_;
+}
+
+void DssimHistogram::Partition(std::uint32_t threshold, std::uint64_t& hiCount, std::uint64_t& hiSum) const {
+    if (threshold >= kFineLimit) {
+        hiCount = 0;
+        hiSum = 0;
+        for (std::uint32_t b = (threshold >> kFineBits) + 1u; b < coarse_.size(); ++b) {
+            hiCount += coarse_[b].count;
+            hiSum += coarse_[b].sum;
+        }
+        return;
+    }
+    hiCount = coarseCount_;
+    hiSum = coarseSum_;
+    for (std::uint32_t p = (threshold + 1u) >> kPageBits; p < pages_.size(); ++p) {
+        const std::uint32_t* page = pages_[p].get();
+        if (page == nullptr) {
+            continue;
+        }
+        const std::uint32_t base = p << kPageBits;
+        for (std::uint32_t i = 0; i < kPageSize; ++i) {
+            const std::uint32_t v = base + i;
+            if (v > threshold) {
+                hiCount += page[i];
+                hiSum += static_cast<std::uint64_t>(page[i]) * v;
+            }
+        }
+    }
+}
+
+bool DssimHistogram::Resolves(std::uint32_t threshold) const {
+    return threshold < kFineLimit || coarse_.empty() || coarse_[threshold >> kFineBits].count == 0 ||
+           (threshold & (kFineLimit - 1u)) == kFineLimit - 1u;
+}
+
+void DssimBucketSplit::AddRow(const std::uint32_t* values, std::size_t n) {
+    const std::uint32_t bucket = threshold_ >> DssimHistogram::kFineBits;
+    for (std::size_t i = 0; i < n; ++i) {
+        const std::uint32_t v = values[i];
+        if (v > threshold_ && (v >> DssimHistogram::kFineBits) == bucket) {
+            ++hiCount_;
+            hiSum_ += v;
+        }
+    }
+}
+
+void DssimBucketSplit::Merge(const DssimBucketSplit& other) {
+    hiCount_ += other.hiCount_;
+    hiSum_ += other.hiSum_;
+}
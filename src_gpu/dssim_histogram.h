@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// One-pass accumulator for the reduction of a quantized dssim map (sum, hi_count and
+// hi_sum of ssim_reduce.wgsl), whose threshold depends on the mean and so is only known
+// once every value has been seen. Values below kFineLimit are counted in width-1 bins, so
+// the count and sum above a threshold below the limit follow exactly from the bins and the
+// totals of the larger values. Those larger values go into coarse buckets of kFineLimit
+// values with an exact count and sum each, so a threshold at or above the limit (a mean
+// dssim past about 1% at the default qscale) is exact except for its own bucket, which
+// Resolves() reports and a second pass through DssimBucketSplit settles. Bins are allocated
+// in pages and the buckets on first use, so memory stays under 4 MiB plus 64 KiB of buckets
+// whatever the size of the map. Parts of a map may be added to separate histograms (one per
+// thread) and merged afterwards.
+class DssimHistogram {
+public:
+    static constexpr std::uint32_t kFineBits = 20u;
+    static constexpr std::uint32_t kFineLimit = 1u << kFineBits;
+
+    DssimHistogram();
+
+    void AddRow(const std::uint32_t* values, std::size_t n);
+    void Merge(const DssimHistogram& other);
+
+    std::uint64_t sum() const { return sum_; }
+    std::uint64_t count() const { return count_; }
+
+    // Count and sum of the values above threshold, leaving out those in threshold's own
+    // coarse bucket when Resolves(threshold) is false.
+    void Partition(std::uint32_t threshold, std::uint64_t& hiCount, std::uint64_t& hiSum) const;
+    // Whether Partition(threshold) is exact: always below kFineLimit, above it only when
+    // threshold's bucket is empty or ends at threshold.
+    bool Resolves(std::uint32_t threshold) const;
+
+private:
+    static constexpr std::uint32_t kPageBits = 12u;
+    static constexpr std::uint32_t kPageSize = 1u << kPageBits;
+    static constexpr std::uint32_t kCoarseBuckets = 1u << (32u - kFineBits);
+
+    struct Bucket {
+        std::uint64_t count = 0;
+        std::uint64_t sum = 0;
+    };
+
+    std::vector<std::unique_ptr<std::uint32_t[]>> pages_;
+    // Values at or above kFineLimit by value >> kFineBits; bucket 0 stays empty. Left empty
+    // until the first such value.
+    std::vector<Bucket> coarse_;
+    std::uint64_t coarseCount_ = 0;
+    std::uint64_t coarseSum_ = 0;
+    std::uint64_t count_ = 0;
+    std::uint64_t sum_ = 0;
+};
+
+// Second pass over a level whose threshold DssimHistogram does not resolve: the count and
+// sum of the values above threshold inside threshold's coarse bucket, which complete
+// DssimHistogram::Partition.
+class DssimBucketSplit {
+public:
+    explicit DssimBucketSplit(std::uint32_t threshold) : threshold_(threshold) {}
+
+    void AddRow(const std::uint32_t* values, std::size_t n);
+    void Merge(const DssimBucketSplit& other);
+
+    std::uint64_t hiCount() const { return hiCount_; }
+    std::uint64_t hiSum() const { return hiSum_; }
+
+private:
+    std::uint32_t threshold_;
+    std::uint64_t hiCount_ = 0;
+    std::uint64_t hiSum_ = 0;
+};
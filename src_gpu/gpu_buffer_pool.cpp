@@ -0,0 +1,81 @@
+#include "gpu_buffer_pool.h"
+
+#include <stdexcept>
+
+PooledBuffer::PooledBuffer(GpuBufferPool* pool, wgpu::Buffer buffer)
+    : pool_(pool), buffer_(std::move(buffer)) {}
+
+PooledBuffer::~PooledBuffer() {
+    Reset();
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+    : pool_(std::exchange(other.pool_, nullptr)), buffer_(std::exchange(other.buffer_, nullptr)) {}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+    if (this != &other) {
+        Reset();
+        pool_ = std::exchange(other.pool_, nullptr);
+        buffer_ = std::exchange(other.buffer_, nullptr);
+    }
+    return *this;
+}
+
+void PooledBuffer::Reset() {
+    if (pool_ != nullptr && buffer_) {
+        pool_->Release(std::move(buffer_));
+    }
+    pool_ = nullptr;
+    buffer_ = nullptr;
+}
+
+GpuBufferPool::GpuBufferPool(wgpu::Device device) : device_(std::move(device)) {}
+
+std::uint32_t GpuBufferPool::SizeClassFor(std::uint64_t size) {
+    std::uint32_t sizeClass = kMinSizeClass;
+    while ((std::uint64_t{1} << sizeClass) < size) {
+        ++sizeClass;
+    }
+    return sizeClass;
+}
+
+PooledBuffer GpuBufferPool::Acquire(wgpu::BufferUsage usage, std::uint64_t size) {
+    const std::uint64_t usageBits = static_cast<std::uint64_t>(usage);
+    const std::uint32_t sizeClass = SizeClassFor(size);
+
+    for (std::uint32_t c = sizeClass; c <= sizeClass + kMaxClassSlack; ++c) {
+        const auto it = free_.find(Key{usageBits, c});
+        if (it == free_.end() || it->second.empty()) {
+            continue;
+        }
+        wgpu::Buffer buffer = std::move(it->second.back());
+        it->second.pop_back();
+        ++reuseCount_;
+        return PooledBuffer(this, std::move(buffer));
+    }
+
+    wgpu::BufferDescriptor desc = {};
+    desc.size = std::uint64_t{1} << sizeClass;
+    desc.usage = usage;
+    desc.mappedAtCreation = false;
+    wgpu::Buffer buffer = device_.CreateBuffer(&desc);
+    if (!buffer) {
+        throw std::runtime_error("GpuBufferPool: CreateBuffer failed");
+    }
+    ++allocationCount_;
+    allocatedBytes_ += desc.size;
+    return PooledBuffer(this, std::move(buffer));
+}
+
+void GpuBufferPool::Release(wgpu::Buffer buffer) {
+    if (!buffer) {
+        return;
+    }
+    const std::uint64_t usageBits = static_cast<std::uint64_t>(buffer.GetUsage());
+    const std::uint32_t sizeClass = SizeClassFor(buffer.GetSize());
+    free_[Key{usageBits, sizeClass}].push_back(std::move(buffer));
+}
+
+void GpuBufferPool::Clear() {
+    free_.clear();
+}
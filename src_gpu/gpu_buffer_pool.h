@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <dawn/webgpu_cpp.h>
+
+class GpuBufferPool;
+
+// Owning handle for a buffer borrowed from a GpuBufferPool. The buffer goes back to the
+// pool's free list when the handle is destroyed, so it can be reused by the next scale
+// level or the next comparison without another CreateBuffer call.
+class PooledBuffer {
+public:
+    PooledBuffer() = default;
+    PooledBuffer(GpuBufferPool* pool, wgpu::Buffer buffer);
+    ~PooledBuffer();
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+    const wgpu::Buffer& Get() const { return buffer_; }
+    explicit operator bool() const { return static_cast<bool>(buffer_); }
+
+private:
+    void Reset();
+
+    GpuBufferPool* pool_ = nullptr;
+    wgpu::Buffer buffer_;
+};
+
+// Size-bucketed allocator for wgpu::Buffer. Buffers are keyed by usage and a power-of-two
+// size class; a request is served from its own class first and otherwise from a free
+// buffer at most kMaxClassSlack classes larger, which lets a half-resolution pyramid level
+// reuse the buffers of the level above it.
+class GpuBufferPool {
+public:
+    static constexpr std::uint32_t kMinSizeClass = 8;  // 256 bytes
+    static constexpr std::uint32_t kMaxClassSlack = 2;
+
+    explicit GpuBufferPool(wgpu::Device device = nullptr);
+
+    PooledBuffer Acquire(wgpu::BufferUsage usage, std::uint64_t size);
+    void Release(wgpu::Buffer buffer);
+    void Clear();
+
+    std::uint64_t allocationCount() const { return allocationCount_; }
+    std::uint64_t allocatedBytes() const { return allocatedBytes_; }
+    std::uint64_t reuseCount() const { return reuseCount_; }
+
+    static std::uint32_t SizeClassFor(std::uint64_t size);
+
+private:
+    using Key = std::pair<std::uint64_t, std::uint32_t>;
+
+    wgpu::Device device_;
+    std::map<Key, std::vector<wgpu::Buffer>> free_;
+    std::uint64_t allocationCount_ = 0;
+    std::uint64_t allocatedBytes_ = 0;
+    std::uint64_t reuseCount_ = 0;
+};
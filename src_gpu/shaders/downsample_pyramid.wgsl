@@ -0,0 +1,222 @@
+// Builds every pyramid level of both images in one dispatch, in the style of AMD's single
+// pass downsampler: each 16x16 workgroup owns a 64x64 region of level 0 and reduces it
+// through levels 1..params.levels (at most 4: 32x32, 16x16, 8x8, 4x4) in workgroup memory.
+// workgroup_id.z selects image 0 (bindings 0/1) or image 1 (bindings 3/4).
+//
+// The scorer never needs more than four 2x2 reductions, and a 64x64 region covers all of
+// them, so no workgroup depends on another and the cross-workgroup atomic counter SPD uses
+// for its last levels is not needed.
+//
+// Level k has dimensions floor(level k-1 / 2), so every valid output pixel's 2x2 source
+// block lies inside the level above. Each output is the sum of its four sources in the
+// order top-left, top-right, bottom-left, bottom-right, times 0.25, exactly as the former
+// one-level-per-dispatch kernel computed it.
+
+struct U32Buf {
+    values: array<u32>,
+};
+
+struct Vec4Buf {
+    values: array<vec4<f32>>,
+};
+
+const MAX_LEVELS: u32 = 4u;
+
+// offset: first pixel of the level in the output buffer; unused for textures.
+struct Level {
+    width: u32,
+    height: u32,
+    offset: u32,
+    pad0: u32,
+};
+
+struct Params {
+    in_width: u32,
+    in_height: u32,
+    levels: u32,
+    pad0: u32,
+    level: array<Level, MAX_LEVELS>,
+};
+
+// Buffer pyramid (main): level 0 as the decoder's packed RGBA8, levels 1.. one after the
+// other in one output buffer per image.
+@group(0) @binding(0) var<storage, read> in_packed: U32Buf;
+@group(0) @binding(3) var<storage, read> in_packed2: U32Buf;
+@group(0) @binding(1) var<storage, read_write> out_pixels: Vec4Buf;
+@group(0) @binding(4) var<storage, read_write> out_pixels2: Vec4Buf;
+@group(0) @binding(2) var<uniform> params: Params;
+// Texture pyramid (main_texture): level 0 through its plain rgba8unorm view, so that like
+// the buffer path the pyramid averages sRGB-encoded values; level k is mip k-1 of a
+// two-layer rgba32float texture, layer = image.
+@group(0) @binding(0) var in_texture: texture_2d<f32>;
+@group(0) @binding(3) var in_texture2: texture_2d<f32>;
+@group(0) @binding(1) var out_mip1: texture_storage_2d_array<rgba32float, write>;
+@group(0) @binding(4) var out_mip2: texture_storage_2d_array<rgba32float, write>;
+@group(0) @binding(5) var out_mip3: texture_storage_2d_array<rgba32float, write>;
+@group(0) @binding(6) var out_mip4: texture_storage_2d_array<rgba32float, write>;
+
+const WG: u32 = 16u;
+
+var<workgroup> tile2: array<vec4<f32>, 256>;
+var<workgroup> tile3: array<vec4<f32>, 64>;
+
+// Whether pixel p exists at level k (1-based).
+fn level_valid(k: u32, p: vec2<u32>) -> bool {
+    if (k > params.levels) {
+        return false;
+    }
+    let level = params.level[k - 1u];
+    return p.x < level.width && p.y < level.height;
+}
+
+fn quad_average(tl: vec4<f32>, tr: vec4<f32>, bl: vec4<f32>, br: vec4<f32>) -> vec4<f32> {
+    return (tl + tr + bl + br) * 0.25;
+}
+
+fn load_packed(image: u32, p: vec2<u32>) -> vec4<f32> {
+    let i = p.y * params.in_width + p.x;
+    if (image == 0u) {
+        return unpack4x8unorm(in_packed.values[i]);
+    }
+    return unpack4x8unorm(in_packed2.values[i]);
+}
+
+fn load_texel(image: u32, p: vec2<u32>) -> vec4<f32> {
+    if (image == 0u) {
+        return textureLoad(in_texture, p, 0);
+    }
+    return textureLoad(in_texture2, p, 0);
+}
+
+// Level-1 pixel p, or zero if it lies outside level 1 (such values only feed outputs that
+// are discarded).
+fn level1_packed(image: u32, p: vec2<u32>) -> vec4<f32> {
+    if (!level_valid(1u, p)) {
+        return vec4<f32>(0.0, 0.0, 0.0, 0.0);
+    }
+    let s = p * 2u;
+    return quad_average(load_packed(image, s), load_packed(image, s + vec2<u32>(1u, 0u)),
+                        load_packed(image, s + vec2<u32>(0u, 1u)), load_packed(image, s + vec2<u32>(1u, 1u)));
+}
+
+fn level1_texture(image: u32, p: vec2<u32>) -> vec4<f32> {
+    if (!level_valid(1u, p)) {
+        return vec4<f32>(0.0, 0.0, 0.0, 0.0);
+    }
+    let s = p * 2u;
+    return quad_average(load_texel(image, s), load_texel(image, s + vec2<u32>(1u, 0u)),
+                        load_texel(image, s + vec2<u32>(0u, 1u)), load_texel(image, s + vec2<u32>(1u, 1u)));
+}
+
+// Level-3 pixel of invocation flat < 64 from the level-2 tile.
+fn level3_from_tile(flat: u32) -> vec4<f32> {
+    let b = (flat / 8u) * 2u * WG + (flat % 8u) * 2u;
+    return quad_average(tile2[b], tile2[b + 1u], tile2[b + WG], tile2[b + WG + 1u]);
+}
+
+// Level-4 pixel of invocation flat < 16 from the level-3 tile.
+fn level4_from_tile(flat: u32) -> vec4<f32> {
+    let b = (flat / 4u) * 2u * 8u + (flat % 4u) * 2u;
+    return quad_average(tile3[b], tile3[b + 1u], tile3[b + 8u], tile3[b + 9u]);
+}
+
+fn store_pixel(image: u32, k: u32, p: vec2<u32>, value: vec4<f32>) {
+    if (!level_valid(k, p)) {
+        return;
+    }
+    let level = params.level[k - 1u];
+    let i = level.offset + p.y * level.width + p.x;
+    if (image == 0u) {
+        out_pixels.values[i] = value;
+    } else {
+        out_pixels2.values[i] = value;
+    }
+}
+
+fn store_texel(image: u32, k: u32, p: vec2<u32>, value: vec4<f32>) {
+    if (!level_valid(k, p)) {
+        return;
+    }
+    switch k {
+        case 1u: {
+            textureStore(out_mip1, p, image, value);
+        }
+        case 2u: {
+            textureStore(out_mip2, p, image, value);
+        }
+        case 3u: {
+            textureStore(out_mip3, p, image, value);
+        }
+        default: {
+            textureStore(out_mip4, p, image, value);
+        }
+    }
+}
+
+@compute @workgroup_size(16, 16, 1)
+fn main(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let image = wid.z;
+    let flat = lid.y * WG + lid.x;
+
+    // Each invocation produces a 2x2 quad of level 1 and averages it into one level-2 pixel.
+    let p1 = wid.xy * 32u + lid.xy * 2u;
+    let tl = level1_packed(image, p1);
+    let tr = level1_packed(image, p1 + vec2<u32>(1u, 0u));
+    let bl = level1_packed(image, p1 + vec2<u32>(0u, 1u));
+    let br = level1_packed(image, p1 + vec2<u32>(1u, 1u));
+    store_pixel(image, 1u, p1, tl);
+    store_pixel(image, 1u, p1 + vec2<u32>(1u, 0u), tr);
+    store_pixel(image, 1u, p1 + vec2<u32>(0u, 1u), bl);
+    store_pixel(image, 1u, p1 + vec2<u32>(1u, 1u), br);
+    let l2 = quad_average(tl, tr, bl, br);
+    tile2[flat] = l2;
+    store_pixel(image, 2u, wid.xy * WG + lid.xy, l2);
+    workgroupBarrier();
+
+    if (flat < 64u) {
+        let l3 = level3_from_tile(flat);
+        tile3[flat] = l3;
+        store_pixel(image, 3u, wid.xy * 8u + vec2<u32>(flat % 8u, flat / 8u), l3);
+    }
+    workgroupBarrier();
+
+    if (flat < 16u) {
+        store_pixel(image, 4u, wid.xy * 4u + vec2<u32>(flat % 4u, flat / 4u), level4_from_tile(flat));
+    }
+}
+
+// As main, for texture-backed images.
+@compute @workgroup_size(16, 16, 1)
+fn main_texture(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let image = wid.z;
+    let flat = lid.y * WG + lid.x;
+
+    let p1 = wid.xy * 32u + lid.xy * 2u;
+    let tl = level1_texture(image, p1);
+    let tr = level1_texture(image, p1 + vec2<u32>(1u, 0u));
+    let bl = level1_texture(image, p1 + vec2<u32>(0u, 1u));
+    let br = level1_texture(image, p1 + vec2<u32>(1u, 1u));
+    store_texel(image, 1u, p1, tl);
+    store_texel(image, 1u, p1 + vec2<u32>(1u, 0u), tr);
+    store_texel(image, 1u, p1 + vec2<u32>(0u, 1u), bl);
+    store_texel(image, 1u, p1 + vec2<u32>(1u, 1u), br);
+    let l2 = quad_average(tl, tr, bl, br);
+    tile2[flat] = l2;
+    store_texel(image, 2u, wid.xy * WG + lid.xy, l2);
+    workgroupBarrier();
+
+    if (flat < 64u) {
+        let l3 = level3_from_tile(flat);
+        tile3[flat] = l3;
+        store_texel(image, 3u, wid.xy * 8u + vec2<u32>(flat % 8u, flat / 8u), l3);
+    }
+    workgroupBarrier();
+
+    if (flat < 16u) {
+        store_texel(image, 4u, wid.xy * 4u + vec2<u32>(flat % 4u, flat / 4u), level4_from_tile(flat));
+    }
+}
@@ -0,0 +1,105 @@
+// Shared by lab_preprocess.wgsl, stage0_absdiff.wgsl and ssim_fused.wgsl; the host
+// prepends it (after the lab_t prelude) when it creates those shader modules.
+
+// Level 0 arrives as 8-bit sRGB and is decoded through the host-built srgb_lut instead
+// (see lab_from_packed in the shaders that bind it); this is for the pyramid levels,
+// whose channels are averages and not bytes.
+fn srgb_to_linear(c: f32) -> f32 {
+    if (c <= 0.04045) {
+        return c / 12.92;
+    }
+    return pow((c + 0.055) / 1.055, 2.4);
+}
+
+fn cbrt_poly(x: f32) -> f32 {
+    var y = (-0.5 * x + 1.51) * x + 0.2;
+    var y3 = y * y * y;
+    y = y * (y3 + 2.0 * x) / (2.0 * y3 + x);
+    y3 = y * y * y;
+    y = y * (y3 + 2.0 * x) / (2.0 * y3 + x);
+    return y;
+}
+
+fn lab_from_rgbaplu(px: vec4<f32>, x: i32, y: i32) -> vec3<f32> {
+    var r = px.x;
+    var g = px.y;
+    var b = px.z;
+    let a = px.w;
+
+    // Match dssim-core ToRGB for RGBAPLU pixels.
+    let n = u32((x + 11) ^ (y + 11));
+    if (a < 255.0) {
+        let one_minus_a = 1.0 - a;
+        if ((n & 16u) != 0u) {
+            r = r + one_minus_a;
+        }
+        if ((n & 8u) != 0u) {
+            g = g + one_minus_a;
+        }
+        if ((n & 32u) != 0u) {
+            b = b + one_minus_a;
+        }
+    }
+
+    let d65x = 0.9505;
+    let d65y = 1.0;
+    let d65z = 1.089;
+    let fx = r * (0.4124 / d65x) + g * (0.3576 / d65x) + b * (0.1805 / d65x);
+    let fy = r * (0.2126 / d65y) + g * (0.7152 / d65y) + b * (0.0722 / d65y);
+    let fz = r * (0.0193 / d65z) + g * (0.1192 / d65z) + b * (0.9505 / d65z);
+
+    let epsilon = 216.0 / 24389.0;
+    let k = 24389.0 / (27.0 * 116.0);
+    let X = select(k * fx, cbrt_poly(fx) - 16.0 / 116.0, fx > epsilon);
+    let Y = select(k * fy, cbrt_poly(fy) - 16.0 / 116.0, fy > epsilon);
+    let Z = select(k * fz, cbrt_poly(fz) - 16.0 / 116.0, fz > epsilon);
+
+    let l = Y * 1.05;
+    let a2 = (500.0 / 220.0) * (X - Y) + (86.2 / 220.0);
+    let b2 = (200.0 / 220.0) * (Y - Z) + (107.9 / 220.0);
+    return vec3<f32>(l, a2, b2);
+}
+
+// Lab of a pixel given its linear (not yet premultiplied) colour and its alpha.
+fn lab_from_linear(rgb: vec3<f32>, a: f32, x: u32, y: u32) -> vec3<f32> {
+    return lab_from_rgbaplu(vec4<f32>(rgb * a, a), i32(x), i32(y));
+}
+
+fn lab_from_srgb(px: vec4<f32>, x: u32, y: u32) -> vec3<f32> {
+    let rgb = vec3<f32>(srgb_to_linear(px.r), srgb_to_linear(px.g), srgb_to_linear(px.b));
+    return lab_from_linear(rgb, px.a, x, y);
+}
+
+// 1D factors of the 5x5 Gaussian; the 2D weight of (dx, dy) is GAUSS_5[dx + 2] * GAUSS_5[dy + 2].
+const GAUSS_5 = array<f32, 5>(0.095332, 0.236190, 0.336957, 0.236190, 0.095332);
+
+struct Moments {
+    mu1: vec3<f32>,
+    mu2: vec3<f32>,
+    var1: vec3<f32>,
+    var2: vec3<f32>,
+    cov12: vec3<f32>,
+};
+
+fn dssim_q_from(m: Moments, qscale: u32) -> u32 {
+    let mu1 = m.mu1;
+    let mu2 = m.mu2;
+    let var1 = m.var1;
+    let var2 = m.var2;
+    let cov12 = m.cov12;
+
+    let mu1_sq = (mu1.x * mu1.x + mu1.y * mu1.y + mu1.z * mu1.z) / 3.0;
+    let mu2_sq = (mu2.x * mu2.x + mu2.y * mu2.y + mu2.z * mu2.z) / 3.0;
+    let mu1_mu2 = (mu1.x * mu2.x + mu1.y * mu2.y + mu1.z * mu2.z) / 3.0;
+    let sigma1_sq = (var1.x + var1.y + var1.z) / 3.0;
+    let sigma2_sq = (var2.x + var2.y + var2.z) / 3.0;
+    let sigma12 = (cov12.x + cov12.y + cov12.z) / 3.0;
+
+    let c1 = 0.01 * 0.01;
+    let c2 = 0.03 * 0.03;
+    let numer = (2.0 * mu1_mu2 + c1) * (2.0 * sigma12 + c2);
+    let denom = (mu1_sq + mu2_sq + c1) * (sigma1_sq + sigma2_sq + c2);
+    let ssim = numer / denom;
+    let dssim = clamp(0.5 * (1.0 - ssim), 0.0, 1.0);
+    return u32(round(dssim * f32(qscale)));
+}
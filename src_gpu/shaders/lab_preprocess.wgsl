@@ -1,7 +1,28 @@
+// lab_t (f32, or f16 with `enable f16`) is defined by a prelude the host prepends; see
+// LabShaderPrelude; the Lab conversion lives in dssim_common.wgsl. Lab planes are stored as
+// lab_t, all arithmetic stays in f32.
+//
+// Lab buffers are planar: L, a and b each occupy params.len consecutive elements, so no
+// fetch carries a padding lane. One Lab buffer holds both images (image 1's three planes
+// after image 0's), and every entry point handles both images in a single dispatch with
+// workgroup_id.z selecting the image.
+
+struct U32Buf {
+    values: array<u32>,
+};
+
+struct F32Buf {
+    values: array<f32>,
+};
+
 struct Vec4Buf {
     values: array<vec4<f32>>,
 };
 
+struct LabBuf {
+    values: array<lab_t>,
+};
+
 struct Params {
     len: u32,
     width: u32,
@@ -9,125 +30,183 @@ struct Params {
     qscale: u32,
 };
 
+// The convert entry points read image 0 from binding 0 and image 1 from binding 3.
 @group(0) @binding(0) var<storage, read> in_pixels: Vec4Buf;
-@group(0) @binding(1) var<storage, read_write> out_lab: Vec4Buf;
+@group(0) @binding(3) var<storage, read> in_pixels2: Vec4Buf;
+// Same bindings, for level-0 images uploaded as packed RGBA8 (convert_rgba8).
+@group(0) @binding(0) var<storage, read> in_packed: U32Buf;
+@group(0) @binding(3) var<storage, read> in_packed2: U32Buf;
+// Same bindings again, for texture-backed images (convert_texture, convert_texture_srgb8).
+@group(0) @binding(0) var in_texture: texture_2d<f32>;
+@group(0) @binding(3) var in_texture2: texture_2d<f32>;
+// Same binding again, for the blur pass reading the converted Lab planes.
+@group(0) @binding(0) var<storage, read> in_lab: LabBuf;
+@group(0) @binding(1) var<storage, read_write> out_lab: LabBuf;
 @group(0) @binding(2) var<uniform> params: Params;
+// 256-entry sRGB-to-linear table indexed by the channel byte, built by the host the way
+// dssim-core builds its gamma table. Bound with every convert-layout entry point; only
+// the packed RGBA8 ones read it.
+@group(0) @binding(4) var<storage, read> srgb_lut: F32Buf;
 
-fn srgb_to_linear(c: f32) -> f32 {
-    if (c <= 0.04045) {
-        return c / 12.92;
-    }
-    return pow((c + 0.055) / 1.055, 2.4);
+// Workgroup tile, set by the host from StageTuning (--autotune); stage0_absdiff.wgsl uses
+// the same values. SPAN_* add the 2-pixel blur halo on each side.
+override TILE_X: u32 = 16u;
+override TILE_Y: u32 = 16u;
+override SPAN_X: u32 = TILE_X + 4u;
+override SPAN_Y: u32 = TILE_Y + 4u;
+override SPAN_AREA: u32 = SPAN_X * SPAN_Y;
+// TILE_X columns of every SPAN_Y row: the horizontal pass of the blur.
+override H_AREA: u32 = TILE_X * SPAN_Y;
+
+// First element of `image`'s L plane in a two-image Lab buffer.
+fn lab_base(image: u32) -> u32 {
+    return image * 3u * params.len;
 }
 
-fn cbrt_poly(x: f32) -> f32 {
-    var y = (-0.5 * x + 1.51) * x + 0.2;
-    var y3 = y * y * y;
-    y = y * (y3 + 2.0 * x) / (2.0 * y3 + x);
-    y3 = y * y * y;
-    y = y * (y3 + 2.0 * x) / (2.0 * y3 + x);
-    return y;
+fn store_lab(image: u32, i: u32, lab: vec3<f32>) {
+    let base = lab_base(image) + i;
+    out_lab.values[base] = lab_t(lab.x);
+    out_lab.values[base + params.len] = lab_t(lab.y);
+    out_lab.values[base + 2u * params.len] = lab_t(lab.z);
 }
 
-fn lab_from_rgbaplu(px: vec4<f32>, x: i32, y: i32) -> vec3<f32> {
-    var r = px.x;
-    var g = px.y;
-    var b = px.z;
-    let a = px.w;
-
-    // Match dssim-core ToRGB for RGBAPLU pixels.
-    let n = u32((x + 11) ^ (y + 11));
-    if (a < 255.0) {
-        let one_minus_a = 1.0 - a;
-        if ((n & 16u) != 0u) {
-            r = r + one_minus_a;
-        }
-        if ((n & 8u) != 0u) {
-            g = g + one_minus_a;
-        }
-        if ((n & 32u) != 0u) {
-            b = b + one_minus_a;
-        }
+fn load_texel(image: u32, p: vec2<u32>) -> vec4<f32> {
+    if (image == 0u) {
+        return textureLoad(in_texture, p, 0);
     }
+    return textureLoad(in_texture2, p, 0);
+}
 
-    let d65x = 0.9505;
-    let d65y = 1.0;
-    let d65z = 1.089;
-    let fx = r * (0.4124 / d65x) + g * (0.3576 / d65x) + b * (0.1805 / d65x);
-    let fy = r * (0.2126 / d65y) + g * (0.7152 / d65y) + b * (0.0722 / d65y);
-    let fz = r * (0.0193 / d65z) + g * (0.1192 / d65z) + b * (0.9505 / d65z);
-
-    let epsilon = 216.0 / 24389.0;
-    let k = 24389.0 / (27.0 * 116.0);
-    let X = select(k * fx, cbrt_poly(fx) - 16.0 / 116.0, fx > epsilon);
-    let Y = select(k * fy, cbrt_poly(fy) - 16.0 / 116.0, fy > epsilon);
-    let Z = select(k * fz, cbrt_poly(fz) - 16.0 / 116.0, fz > epsilon);
-
-    let l = Y * 1.05;
-    let a2 = (500.0 / 220.0) * (X - Y) + (86.2 / 220.0);
-    let b2 = (200.0 / 220.0) * (Y - Z) + (107.9 / 220.0);
-    return vec3<f32>(l, a2, b2);
+// Level-0 pixel from the decoder's packed RGBA8: one table load per colour channel.
+fn lab_from_packed(packed: u32, x: u32, y: u32) -> vec3<f32> {
+    let rgb = vec3<f32>(srgb_lut.values[packed & 0xffu],
+                        srgb_lut.values[(packed >> 8u) & 0xffu],
+                        srgb_lut.values[(packed >> 16u) & 0xffu]);
+    return lab_from_linear(rgb, unpack4x8unorm(packed).w, x, y);
 }
 
-fn gaussian_weight_5x5(dx: i32, dy: i32) -> f32 {
-    let ax = abs(dx);
-    let ay = abs(dy);
-    if (ax == 0 && ay == 0) {
-        return 0.113540;
+// Conversion pass: in_pixels/in_pixels2 are the RGBA images, out_lab receives the L, a and
+// b planes of both. Each pixel is converted exactly once.
+@compute @workgroup_size(TILE_X, TILE_Y, 1)
+fn convert(@builtin(global_invocation_id) gid: vec3<u32>) {
+    if (gid.x >= params.width || gid.y >= params.height) {
+        return;
     }
-    if ((ax == 1 && ay == 0) || (ax == 0 && ay == 1)) {
-        return 0.079586;
+    let i = gid.y * params.width + gid.x;
+    var px: vec4<f32>;
+    if (gid.z == 0u) {
+        px = in_pixels.values[i];
+    } else {
+        px = in_pixels2.values[i];
     }
-    if ((ax == 2 && ay == 0) || (ax == 0 && ay == 2)) {
-        return 0.032123;
+    store_lab(gid.z, i, lab_from_srgb(px, gid.x, gid.y));
+}
+
+// As convert, for level-0 images uploaded as the decoder's packed RGBA8 bytes.
+@compute @workgroup_size(TILE_X, TILE_Y, 1)
+fn convert_rgba8(@builtin(global_invocation_id) gid: vec3<u32>) {
+    if (gid.x >= params.width || gid.y >= params.height) {
+        return;
     }
-    if (ax == 1 && ay == 1) {
-        return 0.055786;
+    let i = gid.y * params.width + gid.x;
+    var packed: u32;
+    if (gid.z == 0u) {
+        packed = in_packed.values[i];
+    } else {
+        packed = in_packed2.values[i];
     }
-    if ((ax == 2 && ay == 1) || (ax == 1 && ay == 2)) {
-        return 0.022516;
+    store_lab(gid.z, i, lab_from_packed(packed, gid.x, gid.y));
+}
+
+// As convert, for texture-backed pyramid levels holding sRGB-encoded floats.
+@compute @workgroup_size(TILE_X, TILE_Y, 1)
+fn convert_texture(@builtin(global_invocation_id) gid: vec3<u32>) {
+    if (gid.x >= params.width || gid.y >= params.height) {
+        return;
     }
-    return 0.009088;
+    let px = load_texel(gid.z, gid.xy);
+    store_lab(gid.z, gid.y * params.width + gid.x, lab_from_srgb(px, gid.x, gid.y));
 }
 
-@compute @workgroup_size(64, 1, 1)
-fn main(@builtin(global_invocation_id) gid: vec3<u32>) {
-    let i = gid.x;
-    if (i >= params.len) {
+// As convert, for the level-0 textures read through their rgba8unorm-srgb views: the
+// sampler hardware has already decoded sRGB to linear, so only the premultiply remains.
+@compute @workgroup_size(TILE_X, TILE_Y, 1)
+fn convert_texture_srgb8(@builtin(global_invocation_id) gid: vec3<u32>) {
+    if (gid.x >= params.width || gid.y >= params.height) {
         return;
     }
+    let px = load_texel(gid.z, gid.xy);
+    let input = vec4<f32>(px.rgb * px.a, px.a);
+    store_lab(gid.z, gid.y * params.width + gid.x, lab_from_rgbaplu(input, i32(gid.x), i32(gid.y)));
+}
+
+// Blur pass: in_lab is the output of convert, out_lab receives the L plane unchanged and
+// the blurred a and b planes, for image workgroup_id.z. Each TILE_X x TILE_Y workgroup
+// loads its tile plus a 2-pixel halo (SPAN_X x SPAN_Y) of a/b into workgroup memory once
+// and blurs separably out of it.
+var<workgroup> tile_a: array<f32, SPAN_AREA>;
+var<workgroup> tile_b: array<f32, SPAN_AREA>;
+var<workgroup> h_a: array<f32, H_AREA>;
+var<workgroup> h_b: array<f32, H_AREA>;
+
+@compute @workgroup_size(TILE_X, TILE_Y, 1)
+fn blur(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let width = i32(params.width);
+    let height = i32(params.height);
+    let max_x = width - 1;
+    let max_y = height - 1;
+    let origin_x = i32(wid.x * TILE_X) - 2;
+    let origin_y = i32(wid.y * TILE_Y) - 2;
+    // Tiles whose halo lies inside the image need no edge clamping.
+    let interior = origin_x >= 0 && origin_y >= 0 &&
+        origin_x + i32(SPAN_X) <= width && origin_y + i32(SPAN_Y) <= height;
+    let flat = lid.y * TILE_X + lid.x;
+    let image_base = lab_base(wid.z);
+
+    for (var idx = flat; idx < SPAN_AREA; idx = idx + TILE_X * TILE_Y) {
+        var sx = origin_x + i32(idx % SPAN_X);
+        var sy = origin_y + i32(idx / SPAN_X);
+        if (!interior) {
+            sx = clamp(sx, 0, max_x);
+            sy = clamp(sy, 0, max_y);
+        }
+        let si = u32(sy) * params.width + u32(sx);
+        tile_a[idx] = f32(in_lab.values[image_base + params.len + si]);
+        tile_b[idx] = f32(in_lab.values[image_base + 2u * params.len + si]);
+    }
+    workgroupBarrier();
+
+    for (var idx = flat; idx < H_AREA; idx = idx + TILE_X * TILE_Y) {
+        let base = (idx / TILE_X) * SPAN_X + (idx % TILE_X);
+        var pre_a = 0.0;
+        var pre_b = 0.0;
+        for (var k = 0u; k < 5u; k = k + 1u) {
+            pre_a = pre_a + GAUSS_5[k] * tile_a[base + k];
+            pre_b = pre_b + GAUSS_5[k] * tile_b[base + k];
+        }
+        h_a[idx] = pre_a;
+        h_b[idx] = pre_b;
+    }
+    workgroupBarrier();
 
-    let x = i32(i % params.width);
-    let y = i32(i / params.width);
-    let max_x = i32(params.width) - 1;
-    let max_y = i32(params.height) - 1;
-    let a = in_pixels.values[i].a;
-    let input = vec4<f32>(  srgb_to_linear(in_pixels.values[i].r) * a,
-                            srgb_to_linear(in_pixels.values[i].g) * a,
-                            srgb_to_linear(in_pixels.values[i].b) * a,
-                            a
-                            );
-    let center = lab_from_rgbaplu(input, x, y);
+    let x = wid.x * TILE_X + lid.x;
+    let y = wid.y * TILE_Y + lid.y;
+    if (x >= params.width || y >= params.height) {
+        return;
+    }
 
     var pre_a = 0.0;
     var pre_b = 0.0;
-    for (var dy = -2; dy <= 2; dy = dy + 1) {
-        for (var dx = -2; dx <= 2; dx = dx + 1) {
-            let nx = clamp(x + dx, 0, max_x);
-            let ny = clamp(y + dy, 0, max_y);
-            let ni = u32(ny) * params.width + u32(nx);
-            let w = gaussian_weight_5x5(dx, dy);
-            let a = in_pixels.values[ni].a;
-            let input_ni = vec4<f32>(    srgb_to_linear(in_pixels.values[ni].r) * a,
-                                srgb_to_linear(in_pixels.values[ni].g) * a,
-                                srgb_to_linear(in_pixels.values[ni].b) * a,
-                                a
-                            );
-            let lab = lab_from_rgbaplu(input_ni, nx, ny);
-            pre_a = pre_a + w * lab.y;
-            pre_b = pre_b + w * lab.z;
-        }
+    for (var k = 0u; k < 5u; k = k + 1u) {
+        let hi = (lid.y + k) * TILE_X + lid.x;
+        pre_a = pre_a + GAUSS_5[k] * h_a[hi];
+        pre_b = pre_b + GAUSS_5[k] * h_b[hi];
     }
 
-    out_lab.values[i] = vec4<f32>(center.x, pre_a, pre_b, 0.0);
+    let i = y * params.width + x;
+    out_lab.values[image_base + i] = in_lab.values[image_base + i];
+    out_lab.values[image_base + params.len + i] = lab_t(pre_a);
+    out_lab.values[image_base + 2u * params.len + i] = lab_t(pre_b);
 }
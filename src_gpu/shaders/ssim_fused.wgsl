@@ -0,0 +1,403 @@
+// Fused per-level kernel: RGBA -> Lab, a/b blur, windowed statistics and the quantized
+// dssim map in one pass, without the Lab round trip through global memory that the
+// lab_preprocess.wgsl + stage0_absdiff.wgsl pair makes. Those kernels remain in use for
+// debug dumps, which need the intermediate planes.
+//
+// Each OUT_X x OUT_Y workgroup (8x8 unless StageTuning picks another tile) computes an
+// output tile of that size. The SSIM window needs blurred Lab on a 2-pixel halo (MID_X x
+// MID_Y, "mid" tile) and the a/b blur needs another 2 pixels around that, so the RGBA
+// input is read for a RAW_X x RAW_Y "raw" tile. Results match the separate kernels: raw
+// slots hold clamped source pixels exactly as the unfused blur reads them, and mid slots
+// outside the image take the blurred value of their clamped pixel.
+//
+// Both images are processed by the same workgroup (image 0 at binding 0, image 1 at
+// binding 3). Lab and dssim_q_from come from dssim_common.wgsl; lab_t comes from the host's
+// LabShaderPrelude. Workgroup tiles stay f32, but every value the unfused kernels store to a
+// Lab plane (converted Lab, blurred a/b) is rounded through lab_t at the same point, so
+// --lab-precision f16 gives the same result as those kernels. Workgroup memory:
+// 4 x RAW_AREA (raw a/b) + 4 x HAB_AREA (horizontal a/b) + 2 x 3 x MID_AREA (mid tiles)
+// + 5 x HM_AREA (horizontal moments) floats, 12544 B at 8x8; the host only offers tiles
+// that fit the device (FusedWorkgroupBytes).
+
+struct U32Buf {
+    values: array<u32>,
+};
+
+struct F32Buf {
+    values: array<f32>,
+};
+
+struct Vec4Buf {
+    values: array<vec4<f32>>,
+};
+
+struct Params {
+    len: u32,
+    width: u32,
+    height: u32,
+    qscale: u32,
+};
+
+@group(0) @binding(0) var<storage, read> in_pixels: Vec4Buf;
+@group(0) @binding(3) var<storage, read> in_pixels2: Vec4Buf;
+// Same bindings, for level-0 images uploaded as packed RGBA8 (main_rgba8).
+@group(0) @binding(0) var<storage, read> in_packed: U32Buf;
+@group(0) @binding(3) var<storage, read> in_packed2: U32Buf;
+// Same bindings again, for texture-backed images (main_texture, main_texture_srgb8).
+@group(0) @binding(0) var in_texture: texture_2d<f32>;
+@group(0) @binding(3) var in_texture2: texture_2d<f32>;
+@group(0) @binding(1) var<storage, read_write> out_dssim_q: U32Buf;
+@group(0) @binding(2) var<uniform> params: Params;
+// 256-entry sRGB-to-linear table indexed by the channel byte, built by the host the way
+// dssim-core builds its gamma table. Bound with every convert-layout entry point; only
+// the packed RGBA8 ones read it.
+@group(0) @binding(4) var<storage, read> srgb_lut: F32Buf;
+
+override OUT_X: u32 = 8u;
+override OUT_Y: u32 = 8u;
+override MID_X: u32 = OUT_X + 4u;
+override MID_Y: u32 = OUT_Y + 4u;
+override RAW_X: u32 = OUT_X + 8u;
+override RAW_Y: u32 = OUT_Y + 8u;
+override THREADS: u32 = OUT_X * OUT_Y;
+override RAW_AREA: u32 = RAW_X * RAW_Y;
+override MID_AREA: u32 = MID_X * MID_Y;
+// RAW_Y rows x MID_X columns, MID_Y rows x OUT_X columns.
+override HAB_AREA: u32 = RAW_Y * MID_X;
+override HM_AREA: u32 = MID_Y * OUT_X;
+// Sizes of the planar arrays below; override-sized arrays cannot be nested.
+override RAW_AB_SIZE: u32 = 4u * RAW_AREA;
+override H_AB_SIZE: u32 = 4u * HAB_AREA;
+override MID_TILE_SIZE: u32 = 3u * MID_AREA;
+
+// Plane image * 2 + 0 = a, image * 2 + 1 = b; RAW_AREA (HAB_AREA) floats each.
+var<workgroup> raw_ab: array<f32, RAW_AB_SIZE>;
+var<workgroup> h_ab: array<f32, H_AB_SIZE>;
+// L, a, b planes of MID_AREA floats.
+var<workgroup> tile1: array<f32, MID_TILE_SIZE>;
+var<workgroup> tile2: array<f32, MID_TILE_SIZE>;
+var<workgroup> h_sum1: array<f32, HM_AREA>;
+var<workgroup> h_sum2: array<f32, HM_AREA>;
+var<workgroup> h_sumsq1: array<f32, HM_AREA>;
+var<workgroup> h_sumsq2: array<f32, HM_AREA>;
+var<workgroup> h_sum12: array<f32, HM_AREA>;
+
+// Level-0 pixel from the decoder's packed RGBA8: one table load per colour channel.
+fn lab_from_packed(packed: u32, x: u32, y: u32) -> vec3<f32> {
+    let rgb = vec3<f32>(srgb_lut.values[packed & 0xffu],
+                        srgb_lut.values[(packed >> 8u) & 0xffu],
+                        srgb_lut.values[(packed >> 16u) & 0xffu]);
+    return lab_from_linear(rgb, unpack4x8unorm(packed).w, x, y);
+}
+
+// Image coordinates of raw slot idx of output tile `tile`, clamped to an image of `size`.
+fn raw_coord(tile: vec2<u32>, size: vec2<u32>, idx: u32) -> vec2<u32> {
+    let origin = vec2<i32>(tile * vec2<u32>(OUT_X, OUT_Y)) - vec2<i32>(4, 4);
+    let p = origin + vec2<i32>(i32(idx % RAW_X), i32(idx / RAW_X));
+    let max_p = vec2<i32>(size) - vec2<i32>(1, 1);
+    return vec2<u32>(clamp(p, vec2<i32>(0, 0), max_p));
+}
+
+// Value v after a round trip through a lab_t Lab plane.
+fn lab_round(v: f32) -> f32 {
+    return f32(lab_t(v));
+}
+
+// Records the Lab value of raw slot idx: a/b for the blur, L directly into the mid tile.
+fn store_raw(image: u32, idx: u32, lab_value: vec3<f32>) {
+    let lab = vec3<f32>(lab_round(lab_value.x), lab_round(lab_value.y), lab_round(lab_value.z));
+    raw_ab[image * 2u * RAW_AREA + idx] = lab.y;
+    raw_ab[(image * 2u + 1u) * RAW_AREA + idx] = lab.z;
+    let rx = idx % RAW_X;
+    let ry = idx / RAW_X;
+    if (rx >= 2u && rx < RAW_X - 2u && ry >= 2u && ry < RAW_Y - 2u) {
+        let mid = (ry - 2u) * MID_X + (rx - 2u);
+        if (image == 0u) {
+            tile1[mid] = lab.x;
+        } else {
+            tile2[mid] = lab.x;
+        }
+    }
+}
+
+// Blurs a/b into the mid tiles, then returns the blurred moments of this invocation's
+// pixel. Expects store_raw to have filled every raw slot of both images. Contains workgroup
+// barriers, so it must be called from uniform control flow by every invocation.
+fn fused_moments(lid: vec3<u32>, tile: vec2<u32>, size: vec2<u32>) -> Moments {
+    let flat = lid.y * OUT_X + lid.x;
+    workgroupBarrier();
+
+    // a/b blur, horizontal pass over all RAW_Y raw rows.
+    for (var idx = flat; idx < HAB_AREA; idx = idx + THREADS) {
+        let base = (idx / MID_X) * RAW_X + (idx % MID_X);
+        for (var plane = 0u; plane < 4u; plane = plane + 1u) {
+            var acc = 0.0;
+            for (var k = 0u; k < 5u; k = k + 1u) {
+                acc = acc + GAUSS_5[k] * raw_ab[plane * RAW_AREA + base + k];
+            }
+            h_ab[plane * HAB_AREA + idx] = acc;
+        }
+    }
+    workgroupBarrier();
+
+    // a/b blur, vertical pass into the mid tiles.
+    for (var idx = flat; idx < MID_AREA; idx = idx + THREADS) {
+        let mx = idx % MID_X;
+        let my = idx / MID_X;
+        var blurred: array<f32, 4>;
+        for (var plane = 0u; plane < 4u; plane = plane + 1u) {
+            var acc = 0.0;
+            for (var k = 0u; k < 5u; k = k + 1u) {
+                acc = acc + GAUSS_5[k] * h_ab[plane * HAB_AREA + (my + k) * MID_X + mx];
+            }
+            blurred[plane] = lab_round(acc);
+        }
+        tile1[MID_AREA + idx] = blurred[0];
+        tile1[2u * MID_AREA + idx] = blurred[1];
+        tile2[MID_AREA + idx] = blurred[2];
+        tile2[2u * MID_AREA + idx] = blurred[3];
+    }
+    workgroupBarrier();
+
+    // Mid slots outside the image stand for their clamped pixel; copy its blurred a/b. The
+    // sources are always inside the image and never written here.
+    let width = i32(size.x);
+    let height = i32(size.y);
+    let mid_origin = vec2<i32>(tile * vec2<u32>(OUT_X, OUT_Y)) - vec2<i32>(2, 2);
+    let interior = mid_origin.x >= 0 && mid_origin.y >= 0 &&
+        mid_origin.x + i32(MID_X) <= width && mid_origin.y + i32(MID_Y) <= height;
+    if (!interior) {
+        for (var idx = flat; idx < MID_AREA; idx = idx + THREADS) {
+            let p = mid_origin + vec2<i32>(i32(idx % MID_X), i32(idx / MID_X));
+            let c = clamp(p, vec2<i32>(0, 0), vec2<i32>(width - 1, height - 1));
+            if (any(p != c)) {
+                let src = u32(c.y - mid_origin.y) * MID_X + u32(c.x - mid_origin.x);
+                tile1[MID_AREA + idx] = tile1[MID_AREA + src];
+                tile1[2u * MID_AREA + idx] = tile1[2u * MID_AREA + src];
+                tile2[MID_AREA + idx] = tile2[MID_AREA + src];
+                tile2[2u * MID_AREA + idx] = tile2[2u * MID_AREA + src];
+            }
+        }
+        workgroupBarrier();
+    }
+
+    var sum1 = vec3<f32>(0.0, 0.0, 0.0);
+    var sum2 = vec3<f32>(0.0, 0.0, 0.0);
+    var sumsq1 = vec3<f32>(0.0, 0.0, 0.0);
+    var sumsq2 = vec3<f32>(0.0, 0.0, 0.0);
+    var sum12 = vec3<f32>(0.0, 0.0, 0.0);
+
+    for (var c = 0u; c < 3u; c = c + 1u) {
+        // Horizontal pass over all MID_Y mid rows.
+        for (var idx = flat; idx < HM_AREA; idx = idx + THREADS) {
+            let base = c * MID_AREA + (idx / OUT_X) * MID_X + (idx % OUT_X);
+            var s1 = 0.0;
+            var s2 = 0.0;
+            var q1 = 0.0;
+            var q2 = 0.0;
+            var p12 = 0.0;
+            for (var k = 0u; k < 5u; k = k + 1u) {
+                let w = GAUSS_5[k];
+                let v1 = tile1[base + k];
+                let v2 = tile2[base + k];
+                s1 = s1 + w * v1;
+                s2 = s2 + w * v2;
+                q1 = q1 + w * v1 * v1;
+                q2 = q2 + w * v2 * v2;
+                p12 = p12 + w * v1 * v2;
+            }
+            h_sum1[idx] = s1;
+            h_sum2[idx] = s2;
+            h_sumsq1[idx] = q1;
+            h_sumsq2[idx] = q2;
+            h_sum12[idx] = p12;
+        }
+        workgroupBarrier();
+
+        // Vertical pass for this thread's pixel.
+        var s1 = 0.0;
+        var s2 = 0.0;
+        var q1 = 0.0;
+        var q2 = 0.0;
+        var p12 = 0.0;
+        for (var k = 0u; k < 5u; k = k + 1u) {
+            let w = GAUSS_5[k];
+            let hi = (lid.y + k) * OUT_X + lid.x;
+            s1 = s1 + w * h_sum1[hi];
+            s2 = s2 + w * h_sum2[hi];
+            q1 = q1 + w * h_sumsq1[hi];
+            q2 = q2 + w * h_sumsq2[hi];
+            p12 = p12 + w * h_sum12[hi];
+        }
+        sum1[c] = s1;
+        sum2[c] = s2;
+        sumsq1[c] = q1;
+        sumsq2[c] = q2;
+        sum12[c] = p12;
+        workgroupBarrier();
+    }
+
+    var m: Moments;
+    m.mu1 = sum1;
+    m.mu2 = sum2;
+    m.var1 = max(sumsq1 - sum1 * sum1, vec3<f32>(0.0, 0.0, 0.0));
+    m.var2 = max(sumsq2 - sum2 * sum2, vec3<f32>(0.0, 0.0, 0.0));
+    m.cov12 = sum12 - sum1 * sum2;
+    return m;
+}
+
+fn write_dssim(lid: vec3<u32>, wid: vec3<u32>, m: Moments) {
+    let x = wid.x * OUT_X + lid.x;
+    let y = wid.y * OUT_Y + lid.y;
+    if (x >= params.width || y >= params.height) {
+        return;
+    }
+    out_dssim_q.values[y * params.width + x] = dssim_q_from(m, params.qscale);
+}
+
+@compute @workgroup_size(OUT_X, OUT_Y, 1)
+fn main(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let size = vec2<u32>(params.width, params.height);
+    for (var idx = lid.y * OUT_X + lid.x; idx < RAW_AREA; idx = idx + THREADS) {
+        let p = raw_coord(wid.xy, size, idx);
+        let si = p.y * params.width + p.x;
+        store_raw(0u, idx, lab_from_srgb(in_pixels.values[si], p.x, p.y));
+        store_raw(1u, idx, lab_from_srgb(in_pixels2.values[si], p.x, p.y));
+    }
+    write_dssim(lid, wid, fused_moments(lid, wid.xy, size));
+}
+
+// As main, for level-0 images uploaded as the decoder's packed RGBA8 bytes.
+@compute @workgroup_size(OUT_X, OUT_Y, 1)
+fn main_rgba8(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let size = vec2<u32>(params.width, params.height);
+    for (var idx = lid.y * OUT_X + lid.x; idx < RAW_AREA; idx = idx + THREADS) {
+        let p = raw_coord(wid.xy, size, idx);
+        let si = p.y * params.width + p.x;
+        store_raw(0u, idx, lab_from_packed(in_packed.values[si], p.x, p.y));
+        store_raw(1u, idx, lab_from_packed(in_packed2.values[si], p.x, p.y));
+    }
+    write_dssim(lid, wid, fused_moments(lid, wid.xy, size));
+}
+
+// As main, for texture-backed pyramid levels holding sRGB-encoded floats.
+@compute @workgroup_size(OUT_X, OUT_Y, 1)
+fn main_texture(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let size = vec2<u32>(params.width, params.height);
+    for (var idx = lid.y * OUT_X + lid.x; idx < RAW_AREA; idx = idx + THREADS) {
+        let p = raw_coord(wid.xy, size, idx);
+        store_raw(0u, idx, lab_from_srgb(textureLoad(in_texture, p, 0), p.x, p.y));
+        store_raw(1u, idx, lab_from_srgb(textureLoad(in_texture2, p, 0), p.x, p.y));
+    }
+    write_dssim(lid, wid, fused_moments(lid, wid.xy, size));
+}
+
+// As main, for the level-0 textures read through their rgba8unorm-srgb views (hardware
+// sRGB decode; only the premultiply remains).
+@compute @workgroup_size(OUT_X, OUT_Y, 1)
+fn main_texture_srgb8(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let size = vec2<u32>(params.width, params.height);
+    for (var idx = lid.y * OUT_X + lid.x; idx < RAW_AREA; idx = idx + THREADS) {
+        let p = raw_coord(wid.xy, size, idx);
+        let px1 = textureLoad(in_texture, p, 0);
+        let px2 = textureLoad(in_texture2, p, 0);
+        store_raw(0u, idx, lab_from_rgbaplu(vec4<f32>(px1.rgb * px1.a, px1.a), i32(p.x), i32(p.y)));
+        store_raw(1u, idx, lab_from_rgbaplu(vec4<f32>(px2.rgb * px2.a, px2.a), i32(p.x), i32(p.y)));
+    }
+    write_dssim(lid, wid, fused_moments(lid, wid.xy, size));
+}
+
+// Small-level batching: several pyramid levels in one dispatch. workgroup_id.x is a tile
+// index over all of them; batch.level is the lookup table that maps it to a level and a
+// tile within it. Every level's dssim map lands at its out_offset in out_dssim_q, where
+// ssim_reduce.wgsl reduces each level separately.
+
+// in_offset: first pixel of the level in the input buffers (main_batched); mip: its mip in
+// the input textures (main_batched_texture).
+struct BatchLevel {
+    width: u32,
+    height: u32,
+    in_offset: u32,
+    out_offset: u32,
+    first_tile: u32,
+    tiles_x: u32,
+    mip: u32,
+    pad0: u32,
+};
+
+const MAX_BATCH_LEVELS: u32 = 4u;
+
+struct BatchParams {
+    count: u32,
+    qscale: u32,
+    pad0: u32,
+    pad1: u32,
+    level: array<BatchLevel, MAX_BATCH_LEVELS>,
+};
+
+@group(0) @binding(2) var<uniform> batch: BatchParams;
+
+// Entry of batch.level that owns tile index t (levels are stored in tile order).
+fn batch_level_of(t: u32) -> u32 {
+    var k = 0u;
+    for (var j = 1u; j < batch.count; j = j + 1u) {
+        if (t >= batch.level[j].first_tile) {
+            k = j;
+        }
+    }
+    return k;
+}
+
+fn batch_tile(level: BatchLevel, t: u32) -> vec2<u32> {
+    let index = t - level.first_tile;
+    return vec2<u32>(index % level.tiles_x, index / level.tiles_x);
+}
+
+fn write_batch_dssim(lid: vec3<u32>, level: BatchLevel, tile: vec2<u32>, m: Moments) {
+    let x = tile.x * OUT_X + lid.x;
+    let y = tile.y * OUT_Y + lid.y;
+    if (x >= level.width || y >= level.height) {
+        return;
+    }
+    out_dssim_q.values[level.out_offset + y * level.width + x] = dssim_q_from(m, batch.qscale);
+}
+
+@compute @workgroup_size(OUT_X, OUT_Y, 1)
+fn main_batched(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let level = batch.level[batch_level_of(wid.x)];
+    let tile = batch_tile(level, wid.x);
+    let size = vec2<u32>(level.width, level.height);
+    for (var idx = lid.y * OUT_X + lid.x; idx < RAW_AREA; idx = idx + THREADS) {
+        let p = raw_coord(tile, size, idx);
+        let si = level.in_offset + p.y * level.width + p.x;
+        store_raw(0u, idx, lab_from_srgb(in_pixels.values[si], p.x, p.y));
+        store_raw(1u, idx, lab_from_srgb(in_pixels2.values[si], p.x, p.y));
+    }
+    write_batch_dssim(lid, level, tile, fused_moments(lid, tile, size));
+}
+
+// As main_batched, reading each level from its mip of the texture-backed pyramid.
+@compute @workgroup_size(OUT_X, OUT_Y, 1)
+fn main_batched_texture(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let level = batch.level[batch_level_of(wid.x)];
+    let tile = batch_tile(level, wid.x);
+    let size = vec2<u32>(level.width, level.height);
+    for (var idx = lid.y * OUT_X + lid.x; idx < RAW_AREA; idx = idx + THREADS) {
+        let p = raw_coord(tile, size, idx);
+        store_raw(0u, idx, lab_from_srgb(textureLoad(in_texture, p, level.mip), p.x, p.y));
+        store_raw(1u, idx, lab_from_srgb(textureLoad(in_texture2, p, level.mip), p.x, p.y));
+    }
+    write_batch_dssim(lid, level, tile, fused_moments(lid, tile, size));
+}
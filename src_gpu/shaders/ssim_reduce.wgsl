@@ -0,0 +1,240 @@
+// Reduces one level's quantized dssim map to the handful of integers the host needs to
+// score that level:
+//   sum      = sum(q)
+//   hi_count = count(q > threshold)
+//   hi_sum   = sum(q where q > threshold)
+// with threshold = floor((1 - avg) * qscale / 2), avg = pow(max(mean_ssim, 0), exponent).
+// The host turns these into the mean absolute deviation exactly, because for integer q
+// sum(|q - t|) = (hi_sum - hi_count * t) + ((len - hi_count) * t - (sum - hi_sum)) when the
+// split is at floor(t). The threshold here is f32; a level where it misses the host's
+// double floor(t) is partitioned again with the host's value (ResolveLevelStats).
+//
+// 64-bit sums are carried as vec2<u32>(lo, hi) so that accumulation is exact and the
+// result does not depend on workgroup scheduling.
+//
+// Several levels can be reduced by the same dispatches: dssim_q then holds them one after
+// the other, params.level[z] describes level z, and workgroup_id.z selects it. Level z
+// uses partials.values[z * MAX_GROUPS ..] and writes stats.values[z].
+//
+// Dispatch order: sum_partials (max num_groups x 1 x count workgroups), sum_final
+// (1 x 1 x count), partition_partials (as sum_partials), partition_final (as sum_final).
+// ssim_reduce_subgroups.wgsl, appended by the host when the device has subgroups, adds
+// *_subgroup variants of the four entry points that combine each subgroup with
+// subgroupAdd before the workgroup step.
+
+struct U32Buf {
+    values: array<u32>,
+};
+
+// x/y: 64-bit sum, z: count, w: unused.
+struct PartialBuf {
+    values: array<vec4<u32>>,
+};
+
+struct LevelStats {
+    sum: vec2<u32>,
+    threshold: u32,
+    hi_count: u32,
+    hi_sum: vec2<u32>,
+    pad0: u32,
+    pad1: u32,
+};
+
+struct StatsBuf {
+    values: array<LevelStats>,
+};
+
+// offset: first element of the level in dssim_q.
+struct LevelParams {
+    offset: u32,
+    len: u32,
+    num_groups: u32,
+    exponent: f32,
+};
+
+const MAX_LEVELS: u32 = 5u;
+
+struct Params {
+    qscale: u32,
+    pad0: u32,
+    pad1: u32,
+    pad2: u32,
+    level: array<LevelParams, MAX_LEVELS>,
+};
+
+@group(0) @binding(0) var<storage, read> dssim_q: U32Buf;
+@group(0) @binding(1) var<storage, read_write> partials: PartialBuf;
+@group(0) @binding(2) var<storage, read_write> stats: StatsBuf;
+@group(0) @binding(3) var<uniform> params: Params;
+
+// Pipeline-overridable so --autotune can pick per adapter; see ReduceTuning on the host.
+// WG must be a power of two for the tree in combine_workgroup. MAX_GROUPS is both the cap
+// on num_groups and the stride between levels in partials.
+override WG: u32 = 256u;
+override MAX_GROUPS: u32 = 256u;
+
+var<workgroup> wg_sum: array<vec2<u32>, WG>;
+var<workgroup> wg_count: array<u32, WG>;
+
+fn add64(a: vec2<u32>, b: vec2<u32>) -> vec2<u32> {
+    let lo = a.x + b.x;
+    let carry = select(0u, 1u, lo < a.x);
+    return vec2<u32>(lo, a.y + b.y + carry);
+}
+
+fn to_f32(a: vec2<u32>) -> f32 {
+    return f32(a.y) * 4294967296.0 + f32(a.x);
+}
+
+// One invocation's running totals.
+struct Acc {
+    sum: vec2<u32>,
+    count: u32,
+};
+
+// Levels with fewer groups than the dispatch leave the extra workgroups idle.
+fn group_active(wid: vec3<u32>) -> bool {
+    return wid.x < params.level[wid.z].num_groups;
+}
+
+// Tree-reduces every invocation's acc into wg_sum[0] / wg_count[0].
+fn combine_workgroup(lid: u32, acc: Acc) {
+    wg_sum[lid] = acc.sum;
+    wg_count[lid] = acc.count;
+    workgroupBarrier();
+    for (var stride = WG / 2u; stride > 0u; stride = stride / 2u) {
+        if (lid < stride) {
+            wg_sum[lid] = add64(wg_sum[lid], wg_sum[lid + stride]);
+            wg_count[lid] = wg_count[lid] + wg_count[lid + stride];
+        }
+        workgroupBarrier();
+    }
+}
+
+fn sum_partials_lane(lid: u32, wid: vec3<u32>) -> Acc {
+    let level = params.level[wid.z];
+    var acc = vec2<u32>(0u, 0u);
+    let stride = level.num_groups * WG;
+    for (var i = wid.x * WG + lid; i < level.len; i = i + stride) {
+        acc = add64(acc, vec2<u32>(dssim_q.values[level.offset + i], 0u));
+    }
+    return Acc(acc, 0u);
+}
+
+fn sum_final_lane(lid: u32, wid: vec3<u32>) -> Acc {
+    var acc = vec2<u32>(0u, 0u);
+    for (var i = lid; i < params.level[wid.z].num_groups; i = i + WG) {
+        acc = add64(acc, partials.values[wid.z * MAX_GROUPS + i].xy);
+    }
+    return Acc(acc, 0u);
+}
+
+fn partition_partials_lane(lid: u32, wid: vec3<u32>) -> Acc {
+    let level = params.level[wid.z];
+    let threshold = stats.values[wid.z].threshold;
+    var acc = vec2<u32>(0u, 0u);
+    var count = 0u;
+    let stride = level.num_groups * WG;
+    for (var i = wid.x * WG + lid; i < level.len; i = i + stride) {
+        let q = dssim_q.values[level.offset + i];
+        if (q > threshold) {
+            acc = add64(acc, vec2<u32>(q, 0u));
+            count = count + 1u;
+        }
+    }
+    return Acc(acc, count);
+}
+
+fn partition_final_lane(lid: u32, wid: vec3<u32>) -> Acc {
+    var acc = vec2<u32>(0u, 0u);
+    var count = 0u;
+    for (var i = lid; i < params.level[wid.z].num_groups; i = i + WG) {
+        let p = partials.values[wid.z * MAX_GROUPS + i];
+        acc = add64(acc, p.xy);
+        count = count + p.z;
+    }
+    return Acc(acc, count);
+}
+
+// The store_* helpers publish the combined wg_sum[0] / wg_count[0]; invocation 0 only.
+fn store_partial(wid: vec3<u32>) {
+    partials.values[wid.z * MAX_GROUPS + wid.x] = vec4<u32>(wg_sum[0].x, wg_sum[0].y, wg_count[0], 0u);
+}
+
+// 1 - avg is taken through 1 - m^(e/2) = (1 - m^e) / (1 + m^(e/2)) from 1 - m = 2 mean_dssim,
+// halving e down to the level's exponent, instead of as 1 - pow(m, e): the subtraction would
+// cancel most of the f32 bits, and the host needs this threshold to match its floor(t).
+fn store_sum(wid: vec3<u32>) {
+    let level = params.level[wid.z];
+    let total = wg_sum[0];
+    let mean_dssim = to_f32(total) / (f32(level.len) * f32(params.qscale));
+    var m = 1.0 - 2.0 * mean_dssim;
+    var one_minus_avg = 1.0;
+    if (m > 0.0) {
+        one_minus_avg = 2.0 * mean_dssim;
+        for (var e = 1.0; e > level.exponent; e = e * 0.5) {
+            m = sqrt(m);
+            one_minus_avg = one_minus_avg / (1.0 + m);
+        }
+    }
+    let t = max(floor(one_minus_avg * f32(params.qscale) * 0.5), 0.0);
+    var level_stats: LevelStats;
+    level_stats.sum = total;
+    level_stats.threshold = u32(min(t, 4294967040.0));
+    level_stats.hi_count = 0u;
+    level_stats.hi_sum = vec2<u32>(0u, 0u);
+    level_stats.pad0 = 0u;
+    level_stats.pad1 = 0u;
+    stats.values[wid.z] = level_stats;
+}
+
+fn store_partition(wid: vec3<u32>) {
+    stats.values[wid.z].hi_sum = wg_sum[0];
+    stats.values[wid.z].hi_count = wg_count[0];
+}
+
+@compute @workgroup_size(WG, 1, 1)
+fn sum_partials(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    if (!group_active(wid)) {
+        return;
+    }
+    combine_workgroup(lid.x, sum_partials_lane(lid.x, wid));
+    if (lid.x == 0u) {
+        store_partial(wid);
+    }
+}
+
+@compute @workgroup_size(WG, 1, 1)
+fn sum_final(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    combine_workgroup(lid.x, sum_final_lane(lid.x, wid));
+    if (lid.x == 0u) {
+        store_sum(wid);
+    }
+}
+
+@compute @workgroup_size(WG, 1, 1)
+fn partition_partials(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    if (!group_active(wid)) {
+        return;
+    }
+    combine_workgroup(lid.x, partition_partials_lane(lid.x, wid));
+    if (lid.x == 0u) {
+        store_partial(wid);
+    }
+}
+
+@compute @workgroup_size(WG, 1, 1)
+fn partition_final(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    combine_workgroup(lid.x, partition_final_lane(lid.x, wid));
+    if (lid.x == 0u) {
+        store_partition(wid);
+    }
+}
@@ -0,0 +1,91 @@
+// Subgroup variants of the ssim_reduce.wgsl entry points. The host appends this file to
+// ssim_reduce.wgsl and prepends `enable subgroups;` only when the device was created with
+// the Subgroups feature; otherwise the shared-memory entry points are used unchanged.
+//
+// Each subgroup first combines its lanes with subgroupAdd, then one lane per subgroup
+// publishes the result into a workgroup slot and invocation 0 adds the slots. That
+// replaces the log2(WG)-step barrier tree with two barriers. WebGPU does not specify how
+// invocations map to subgroups or how large a subgroup is, so slots are claimed with an
+// atomic instead of derived from local_invocation_id.
+//
+// The 64-bit sums are added as three u32 partials (low and high 16 bits of the low word,
+// and the high word) so that no subgroupAdd can wrap: subgroups have at most 128 lanes.
+
+// Number of wg_sum / wg_count slots claimed so far; workgroup memory starts zeroed.
+var<workgroup> wg_subgroups: atomic<u32>;
+
+fn subgroup_sum64(v: vec2<u32>) -> vec2<u32> {
+    let lo = subgroupAdd(v.x & 0xffffu);
+    let hi = subgroupAdd(v.x >> 16u);
+    let top = subgroupAdd(v.y);
+    return add64(vec2<u32>(lo, top), vec2<u32>(hi << 16u, hi >> 16u));
+}
+
+// Combines every invocation's acc into wg_sum[0] / wg_count[0], like combine_workgroup.
+fn combine_subgroups(lid: u32, lane: u32, acc: Acc) {
+    let sum = subgroup_sum64(acc.sum);
+    let count = subgroupAdd(acc.count);
+    if (lane == 0u) {
+        let slot = atomicAdd(&wg_subgroups, 1u);
+        wg_sum[slot] = sum;
+        wg_count[slot] = count;
+    }
+    workgroupBarrier();
+    if (lid == 0u) {
+        let slots = atomicLoad(&wg_subgroups);
+        for (var i = 1u; i < slots; i = i + 1u) {
+            wg_sum[0] = add64(wg_sum[0], wg_sum[i]);
+            wg_count[0] = wg_count[0] + wg_count[i];
+        }
+    }
+}
+
+@compute @workgroup_size(WG, 1, 1)
+fn sum_partials_subgroup(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>,
+    @builtin(subgroup_invocation_id) lane: u32) {
+    if (!group_active(wid)) {
+        return;
+    }
+    combine_subgroups(lid.x, lane, sum_partials_lane(lid.x, wid));
+    if (lid.x == 0u) {
+        store_partial(wid);
+    }
+}
+
+@compute @workgroup_size(WG, 1, 1)
+fn sum_final_subgroup(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>,
+    @builtin(subgroup_invocation_id) lane: u32) {
+    combine_subgroups(lid.x, lane, sum_final_lane(lid.x, wid));
+    if (lid.x == 0u) {
+        store_sum(wid);
+    }
+}
+
+@compute @workgroup_size(WG, 1, 1)
+fn partition_partials_subgroup(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>,
+    @builtin(subgroup_invocation_id) lane: u32) {
+    if (!group_active(wid)) {
+        return;
+    }
+    combine_subgroups(lid.x, lane, partition_partials_lane(lid.x, wid));
+    if (lid.x == 0u) {
+        store_partial(wid);
+    }
+}
+
+@compute @workgroup_size(WG, 1, 1)
+fn partition_final_subgroup(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>,
+    @builtin(subgroup_invocation_id) lane: u32) {
+    combine_subgroups(lid.x, lane, partition_final_lane(lid.x, wid));
+    if (lid.x == 0u) {
+        store_partition(wid);
+    }
+}
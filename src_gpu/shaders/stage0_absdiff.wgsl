@@ -1,3 +1,8 @@
+// lab_t (f32 or f16) is defined by a prelude the host prepends; see LabShaderPrelude.
+// Moments and dssim_q_from live in dssim_common.wgsl.
+// in_lab holds both images as planar Lab (image 0's L, a, b planes of params.len elements
+// each, then image 1's), as written by lab_preprocess.wgsl.
+
 struct U32Buf {
     values: array<u32>,
 };
@@ -6,8 +11,8 @@ struct F32Buf {
     values: array<f32>,
 };
 
-struct Vec4Buf {
-    values: array<vec4<f32>>,
+struct LabBuf {
+    values: array<lab_t>,
 };
 
 struct Params {
@@ -17,48 +22,66 @@ struct Params {
     qscale: u32,
 };
 
-@group(0) @binding(0) var<storage, read> in1: Vec4Buf;
-@group(0) @binding(1) var<storage, read> in2: Vec4Buf;
-@group(0) @binding(2) var<storage, read_write> out_dssim_q: U32Buf;
+@group(0) @binding(0) var<storage, read> in_lab: LabBuf;
+@group(0) @binding(1) var<storage, read_write> out_dssim_q: U32Buf;
+@group(0) @binding(2) var<uniform> params: Params;
+// Debug planes; only bound for the full-stats entry point (main_debug).
 @group(0) @binding(3) var<storage, read_write> out_mu1: F32Buf;
 @group(0) @binding(4) var<storage, read_write> out_mu2: F32Buf;
 @group(0) @binding(5) var<storage, read_write> out_var1: F32Buf;
 @group(0) @binding(6) var<storage, read_write> out_var2: F32Buf;
 @group(0) @binding(7) var<storage, read_write> out_cov12: F32Buf;
-@group(0) @binding(8) var<uniform> params: Params;
 
-fn gaussian_weight_5x5(dx: i32, dy: i32) -> f32 {
-    let ax = abs(dx);
-    let ay = abs(dy);
-    if (ax == 0 && ay == 0) {
-        return 0.113540;
-    }
-    if ((ax == 1 && ay == 0) || (ax == 0 && ay == 1)) {
-        return 0.079586;
-    }
-    if ((ax == 2 && ay == 0) || (ax == 0 && ay == 2)) {
-        return 0.032123;
-    }
-    if (ax == 1 && ay == 1) {
-        return 0.055786;
-    }
-    if ((ax == 2 && ay == 1) || (ax == 1 && ay == 2)) {
-        return 0.022516;
-    }
-    return 0.009088;
-}
+// Each TILE_X x TILE_Y workgroup loads its tile plus a 2-pixel halo (SPAN_X x SPAN_Y) of
+// both Lab images into workgroup memory once, then runs the separable blur out of it one
+// channel at a time. The tile is set by the host from StageTuning, as in
+// lab_preprocess.wgsl. Workgroup memory: 2 x 3 x SPAN_AREA (inputs) + 5 x H_AREA
+// (horizontal moments) floats, 16000 B at the default 16x16.
+override TILE_X: u32 = 16u;
+override TILE_Y: u32 = 16u;
+override SPAN_X: u32 = TILE_X + 4u;
+override SPAN_Y: u32 = TILE_Y + 4u;
+override SPAN_AREA: u32 = SPAN_X * SPAN_Y;
+override H_AREA: u32 = TILE_X * SPAN_Y;
+// L, a, b planes of one image, SPAN_AREA each (override-sized arrays cannot be nested).
+override LAB_TILE_AREA: u32 = 3u * SPAN_AREA;
 
-@compute @workgroup_size(64, 1, 1)
-fn main(@builtin(global_invocation_id) gid: vec3<u32>) {
-    let i = gid.x;
-    if (i >= params.len) {
-        return;
-    }
+var<workgroup> tile1: array<f32, LAB_TILE_AREA>;
+var<workgroup> tile2: array<f32, LAB_TILE_AREA>;
+var<workgroup> h_sum1: array<f32, H_AREA>;
+var<workgroup> h_sum2: array<f32, H_AREA>;
+var<workgroup> h_sumsq1: array<f32, H_AREA>;
+var<workgroup> h_sumsq2: array<f32, H_AREA>;
+var<workgroup> h_sum12: array<f32, H_AREA>;
 
-    let x = i32(i % params.width);
-    let y = i32(i / params.width);
-    let max_x = i32(params.width) - 1;
-    let max_y = i32(params.height) - 1;
+// Blurred moments of this invocation's pixel. Contains workgroup barriers, so it must be
+// called from uniform control flow by every invocation of the workgroup.
+fn blur_moments(lid: vec3<u32>, wid: vec3<u32>) -> Moments {
+    let width = i32(params.width);
+    let height = i32(params.height);
+    let max_x = width - 1;
+    let max_y = height - 1;
+    let origin_x = i32(wid.x * TILE_X) - 2;
+    let origin_y = i32(wid.y * TILE_Y) - 2;
+    // Tiles whose halo lies inside the image need no edge clamping.
+    let interior = origin_x >= 0 && origin_y >= 0 &&
+        origin_x + i32(SPAN_X) <= width && origin_y + i32(SPAN_Y) <= height;
+    let flat = lid.y * TILE_X + lid.x;
+
+    for (var idx = flat; idx < SPAN_AREA; idx = idx + TILE_X * TILE_Y) {
+        var sx = origin_x + i32(idx % SPAN_X);
+        var sy = origin_y + i32(idx / SPAN_X);
+        if (!interior) {
+            sx = clamp(sx, 0, max_x);
+            sy = clamp(sy, 0, max_y);
+        }
+        let si = u32(sy) * params.width + u32(sx);
+        for (var c = 0u; c < 3u; c = c + 1u) {
+            tile1[c * SPAN_AREA + idx] = f32(in_lab.values[c * params.len + si]);
+            tile2[c * SPAN_AREA + idx] = f32(in_lab.values[(3u + c) * params.len + si]);
+        }
+    }
+    workgroupBarrier();
 
     var sum1 = vec3<f32>(0.0, 0.0, 0.0);
     var sum2 = vec3<f32>(0.0, 0.0, 0.0);
@@ -66,49 +89,95 @@ fn main(@builtin(global_invocation_id) gid: vec3<u32>) {
     var sumsq2 = vec3<f32>(0.0, 0.0, 0.0);
     var sum12 = vec3<f32>(0.0, 0.0, 0.0);
 
-    for (var dy = -2; dy <= 2; dy = dy + 1) {
-        for (var dx = -2; dx <= 2; dx = dx + 1) {
-            let nx = clamp(x + dx, 0, max_x);
-            let ny = clamp(y + dy, 0, max_y);
-            let ni = u32(ny) * params.width + u32(nx);
-            let w = gaussian_weight_5x5(dx, dy);
-
-            let lab1 = in1.values[ni].xyz;
-            let lab2 = in2.values[ni].xyz;
+    for (var c = 0u; c < 3u; c = c + 1u) {
+        // Horizontal pass over all SPAN_Y rows of the tile.
+        for (var idx = flat; idx < H_AREA; idx = idx + TILE_X * TILE_Y) {
+            let base = c * SPAN_AREA + (idx / TILE_X) * SPAN_X + (idx % TILE_X);
+            var s1 = 0.0;
+            var s2 = 0.0;
+            var q1 = 0.0;
+            var q2 = 0.0;
+            var p12 = 0.0;
+            for (var k = 0u; k < 5u; k = k + 1u) {
+                let w = GAUSS_5[k];
+                let v1 = tile1[base + k];
+                let v2 = tile2[base + k];
+                s1 = s1 + w * v1;
+                s2 = s2 + w * v2;
+                q1 = q1 + w * v1 * v1;
+                q2 = q2 + w * v2 * v2;
+                p12 = p12 + w * v1 * v2;
+            }
+            h_sum1[idx] = s1;
+            h_sum2[idx] = s2;
+            h_sumsq1[idx] = q1;
+            h_sumsq2[idx] = q2;
+            h_sum12[idx] = p12;
+        }
+        workgroupBarrier();
 
-            sum1 = sum1 + w * lab1;
-            sum2 = sum2 + w * lab2;
-            sumsq1 = sumsq1 + w * lab1 * lab1;
-            sumsq2 = sumsq2 + w * lab2 * lab2;
-            sum12 = sum12 + w * lab1 * lab2;
+        // Vertical pass for this thread's pixel.
+        var s1 = 0.0;
+        var s2 = 0.0;
+        var q1 = 0.0;
+        var q2 = 0.0;
+        var p12 = 0.0;
+        for (var k = 0u; k < 5u; k = k + 1u) {
+            let w = GAUSS_5[k];
+            let hi = (lid.y + k) * TILE_X + lid.x;
+            s1 = s1 + w * h_sum1[hi];
+            s2 = s2 + w * h_sum2[hi];
+            q1 = q1 + w * h_sumsq1[hi];
+            q2 = q2 + w * h_sumsq2[hi];
+            p12 = p12 + w * h_sum12[hi];
         }
+        sum1[c] = s1;
+        sum2[c] = s2;
+        sumsq1[c] = q1;
+        sumsq2[c] = q2;
+        sum12[c] = p12;
+        workgroupBarrier();
     }
 
-    let mu1 = sum1;
-    let mu2 = sum2;
-    let var1 = max(sumsq1 - mu1 * mu1, vec3<f32>(0.0, 0.0, 0.0));
-    let var2 = max(sumsq2 - mu2 * mu2, vec3<f32>(0.0, 0.0, 0.0));
-    let cov12 = sum12 - mu1 * mu2;
-
-    let mu1_sq = (mu1.x * mu1.x + mu1.y * mu1.y + mu1.z * mu1.z) / 3.0;
-    let mu2_sq = (mu2.x * mu2.x + mu2.y * mu2.y + mu2.z * mu2.z) / 3.0;
-    let mu1_mu2 = (mu1.x * mu2.x + mu1.y * mu2.y + mu1.z * mu2.z) / 3.0;
-    let sigma1_sq = (var1.x + var1.y + var1.z) / 3.0;
-    let sigma2_sq = (var2.x + var2.y + var2.z) / 3.0;
-    let sigma12 = (cov12.x + cov12.y + cov12.z) / 3.0;
+    var m: Moments;
+    m.mu1 = sum1;
+    m.mu2 = sum2;
+    m.var1 = max(sumsq1 - sum1 * sum1, vec3<f32>(0.0, 0.0, 0.0));
+    m.var2 = max(sumsq2 - sum2 * sum2, vec3<f32>(0.0, 0.0, 0.0));
+    m.cov12 = sum12 - sum1 * sum2;
+    return m;
+}
 
-    let c1 = 0.01 * 0.01;
-    let c2 = 0.03 * 0.03;
-    let numer = (2.0 * mu1_mu2 + c1) * (2.0 * sigma12 + c2);
-    let denom = (mu1_sq + mu2_sq + c1) * (sigma1_sq + sigma2_sq + c2);
-    let ssim = numer / denom;
-    let dssim = clamp(0.5 * (1.0 - ssim), 0.0, 1.0);
-    let dssim_q = u32(round(dssim * f32(params.qscale)));
+// Production entry point: writes only the quantized dssim map.
+@compute @workgroup_size(TILE_X, TILE_Y, 1)
+fn main(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let m = blur_moments(lid, wid);
+    let x = wid.x * TILE_X + lid.x;
+    let y = wid.y * TILE_Y + lid.y;
+    if (x >= params.width || y >= params.height) {
+        return;
+    }
+    out_dssim_q.values[y * params.width + x] = dssim_q_from(m, params.qscale);
+}
 
-    out_dssim_q.values[i] = dssim_q;
-    out_mu1.values[i] = mu1.x;
-    out_mu2.values[i] = mu2.x;
-    out_var1.values[i] = var1.x;
-    out_var2.values[i] = var2.x;
-    out_cov12.values[i] = cov12.x;
+// Debug-dump entry point: additionally writes the first channel of mu/var/cov.
+@compute @workgroup_size(TILE_X, TILE_Y, 1)
+fn main_debug(
+    @builtin(local_invocation_id) lid: vec3<u32>,
+    @builtin(workgroup_id) wid: vec3<u32>) {
+    let m = blur_moments(lid, wid);
+    let x = wid.x * TILE_X + lid.x;
+    let y = wid.y * TILE_Y + lid.y;
+    if (x >= params.width || y >= params.height) {
+        return;
+    }
+    let i = y * params.width + x;
+    out_dssim_q.values[i] = dssim_q_from(m, params.qscale);
+    out_mu1.values[i] = m.mu1.x;
+    out_mu2.values[i] = m.mu2.x;
+    out_var1.values[i] = m.var1.x;
+    out_var2.values[i] = m.var2.x;
+    out_cov12.values[i] = m.cov12.x;
 }
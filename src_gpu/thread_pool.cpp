@@ -0,0 +1,294 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace {
+
+thread_local unsigned currentSlot = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    const unsigned count = std::max(1u, threadCount);
+    ranges_ = std::make_unique<Range[]>(count);
+    workers_.reserve(count - 1u);
+    for (unsigned slot = 1; slot < count; ++slot) {
+        workers_.emplace_back([this, slot]() { WorkerMain(slot); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(std::uint32_t count, const std::function<void(std::uint32_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    const unsigned threads = threadCount();
+    if (threads == 1 || count == 1) {
+        for (std::uint32_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    for (unsigned slot = 0; slot < threads; ++slot) {
+        Range& range = ranges_[slot];
+        const std::lock_guard<std::mutex> lock(range.mutex);
+        range.begin = static_cast<std::uint32_t>(static_cast<std::uint64_t>(count) * slot / threads);
+        range.end = static_cast<std::uint32_t>(static_cast<std::uint64_t>(count) * (slot + 1u) / threads);
+    }
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &fn;
+        failed_ = false;
+        error_ = nullptr;
+        busyWorkers_ = static_cast<unsigned>(workers_.size());
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    RunJob(0);
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return busyWorkers_ == 0; });
+        job_ = nullptr;
+        error = error_;
+        error_ = nullptr;
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::WorkerMain(unsigned slot) {
+    std::uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+            if (stop_) {
+                return;
+            }
+            seen = generation_;
+        }
+        RunJob(slot);
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            if (--busyWorkers_ == 0) {
+                done_.notify_all();
+            }
+        }
+    }
+}
+
+unsigned ThreadPool::CurrentSlot() {
+    return currentSlot;
+}
+
+void ThreadPool::RunJob(unsigned slot) {
+    const std::function<void(std::uint32_t)>& fn = *job_;
+    currentSlot = slot;
+    std::uint32_t index = 0;
+    while (Pop(slot, index) || Steal(slot, index)) {
+        if (failed_.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        try {
+            fn(index);
+        } catch (...) {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            if (!failed_) {
+                error_ = std::current_exception();
+                failed_ = true;
+            }
+        }
+    }
+}
+
+bool ThreadPool::Pop(unsigned slot, std::uint32_t& index) {
+    Range& range = ranges_[slot];
+    const std::lock_guard<std::mutex> lock(range.mutex);
+    if (range.begin >= range.end) {
+        return false;
+    }
+    index = range.begin++;
+    return true;
+}
+
+bool ThreadPool::Steal(unsigned slot, std::uint32_t& index) {
+    const unsigned threads = threadCount();
+    for (unsigned offset = 1; offset < threads; ++offset) {
+        Range& victim = ranges_[(slot + offset) % threads];
+        std::uint32_t begin = 0;
+        std::uint32_t end = 0;
+        {
+            const std::lock_guard<std::mutex> lock(victim.mutex);
+            const std::uint32_t remaining = victim.end - std::min(victim.begin, victim.end);
+            if (remaining == 0) {
+                continue;
+            }
+            // Take the back half (at least one index), leaving the victim its front.
+            end = victim.end;
+            begin = end - (remaining + 1u) / 2u;
+            victim.end = begin;
+        }
+        index = begin;
+        Range& own = ranges_[slot];
+        const std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin + 1u;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
+
+std::uint32_t RowBandHeight(std::uint32_t height, unsigned threadCount, std::uint32_t minRows) {
+    const std::uint64_t bands = static_cast<std::uint64_t>(std::max(1u, threadCount)) * 4u;
+    const std::uint64_t rows = (static_cast<std::uint64_t>(height) + bands - 1u) / bands;
+    return static_cast<std::uint32_t>(std::max<std::uint64_t>(rows, std::max(1u, minRows)));
+}
+
+void ParallelRowBands(
+    ThreadPool& pool,
+    std::uint32_t height,
+    std::uint32_t bandRows,
+    std::uint32_t halo,
+    const std::function<void(const RowBand&)>& fn) {
+    const std::uint32_t rows = std::max(1u, bandRows);
+    const std::uint32_t count = static_cast<std::uint32_t>((static_cast<std::uint64_t>(height) + rows - 1u) / rows);
+    pool.ParallelFor(count, [&](std::uint32_t index) {
+        RowBand band;
+        band.begin = index * rows;
+        band.end = std::min(height, band.begin + rows);
+        band.haloBegin = band.begin - std::min(band.begin, halo);
+        band.haloEnd = std::min(height, band.end + halo);
+        fn(band);
+    });
+}
+
+namespace {
+
+#if defined(__linux__)
+// CPUs allowed by a "<quota> <period>" (cpu.max) or separate quota/period (v1) pair;
+// nothing when unlimited.
+std::optional<unsigned> QuotaCpus(long long quota, long long period) {
+    if (quota <= 0 || period <= 0) {
+        return std::nullopt;
+    }
+    return static_cast<unsigned>(std::max(1.0, std::ceil(static_cast<double>(quota) / static_cast<double>(period))));
+}
+
+std::optional<unsigned> CgroupV2Cpus(const std::string& file) {
+    std::ifstream in(file);
+    std::string quota;
+    long long period = 0;
+    if (!(in >> quota >> period) || quota == "max") {
+        return std::nullopt;
+    }
+    try {
+        return QuotaCpus(std::stoll(quota), period);
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+}
+
+std::optional<unsigned> CgroupV1Cpus(const std::string& dir) {
+    std::ifstream quotaIn(dir + "/cpu.cfs_quota_us");
+    std::ifstream periodIn(dir + "/cpu.cfs_period_us");
+    long long quota = 0;
+    long long period = 0;
+    if (!(quotaIn >> quota) || !(periodIn >> period)) {
+        return std::nullopt;
+    }
+    return QuotaCpus(quota, period);
+}
+
+void KeepMin(std::optional<unsigned>& limit, std::optional<unsigned> candidate) {
+    if (candidate && (!limit || *candidate < *limit)) {
+        limit = candidate;
+    }
+}
+
+// Tightest CPU quota on the way from this process's cgroup up to the root. Inside a
+// container the cgroup namespace makes the container's own group the root, so its
+// limit is found at the top of the mount.
+std::optional<unsigned> CgroupCpuLimit() {
+    std::optional<unsigned> limit;
+    std::ifstream in("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(in, line)) {
+        // hierarchy-id:controllers:path
+        const std::size_t first = line.find(':');
+        const std::size_t second = (first == std::string::npos) ? first : line.find(':', first + 1);
+        if (second == std::string::npos) {
+            continue;
+        }
+        const std::string controllers = line.substr(first + 1, second - first - 1);
+        std::string path = line.substr(second + 1);
+        std::string root;
+        if (controllers.empty()) {
+            root = "/sys/fs/cgroup";
+        } else {
+            std::istringstream list(controllers);
+            bool hasCpu = false;
+            for (std::string controller; std::getline(list, controller, ',');) {
+                hasCpu = hasCpu || controller == "cpu";
+            }
+            if (!hasCpu) {
+                continue;
+            }
+            root = "/sys/fs/cgroup/" + controllers;
+            if (!std::ifstream(root + "/cpu.cfs_quota_us")) {
+                root = "/sys/fs/cgroup/cpu";
+            }
+        }
+        for (;;) {
+            const std::string dir = root + (path == "/" ? std::string() : path);
+            KeepMin(limit, controllers.empty() ? CgroupV2Cpus(dir + "/cpu.max") : CgroupV1Cpus(dir));
+            if (path.empty() || path == "/") {
+                break;
+            }
+            const std::size_t slash = path.find_last_of('/');
+            path = (slash == 0 || slash == std::string::npos) ? "/" : path.substr(0, slash);
+        }
+    }
+    return limit;
+}
+#endif
+
+}  // namespace
+
+unsigned DefaultThreadCount() {
+    unsigned count = std::thread::hardware_concurrency();
+#if defined(__linux__)
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0 && CPU_COUNT(&mask) > 0) {
+        count = static_cast<unsigned>(CPU_COUNT(&mask));
+    }
+    if (const std::optional<unsigned> limit = CgroupCpuLimit(); limit && (count == 0 || *limit < count)) {
+        count = *limit;
+    }
+#endif
+    return std::max(1u, count);
+}
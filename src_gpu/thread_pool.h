@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for the host-side loops and the CPU backend. ParallelFor
+// splits an index range evenly over the threads; a thread that runs out of indices steals
+// half of the remaining range of another, so uneven items (image edges, bands with more
+// work) do not leave threads idle. The calling thread takes part as thread 0.
+class ThreadPool {
+public:
+    // threadCount includes the calling thread; 0 is treated as 1.
+    explicit ThreadPool(unsigned threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned threadCount() const { return static_cast<unsigned>(workers_.size()) + 1u; }
+
+    // Runs fn(i) for every i in [0, count) and returns when all have finished. The first
+    // exception thrown by fn is rethrown here; indices not yet started are then skipped.
+    // Not reentrant: fn must not call ParallelFor, and only one thread may call it at a time.
+    void ParallelFor(std::uint32_t count, const std::function<void(std::uint32_t)>& fn);
+
+    // Inside fn: the running thread's index in [0, threadCount()), so fn can keep
+    // per-thread state without locking. 0 outside ParallelFor.
+    static unsigned CurrentSlot();
+
+private:
+    // Indices [begin, end) still owned by one thread. The owner takes from the front,
+    // thieves from the back.
+    struct alignas(64) Range {
+        std::mutex mutex;
+        std::uint32_t begin = 0;
+        std::uint32_t end = 0;
+    };
+
+    void WorkerMain(unsigned slot);
+    void RunJob(unsigned slot);
+    bool Pop(unsigned slot, std::uint32_t& index);
+    bool Steal(unsigned slot, std::uint32_t& index);
+
+    std::vector<std::thread> workers_;
+    std::unique_ptr<Range[]> ranges_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(std::uint32_t)>* job_ = nullptr;
+    std::uint64_t generation_ = 0;
+    unsigned busyWorkers_ = 0;
+    bool stop_ = false;
+    // Set once fn has thrown; read without mutex_ before every index.
+    std::atomic<bool> failed_{false};
+    std::exception_ptr error_;
+};
+
+// Rows [begin, end) of one band of an image, and the rows [haloBegin, haloEnd) that a
+// vertical filter of the band's halo radius reads, clipped to the image. Rows beyond the
+// image edge are the caller's to clamp.
+struct RowBand {
+    std::uint32_t begin = 0;
+    std::uint32_t end = 0;
+    std::uint32_t haloBegin = 0;
+    std::uint32_t haloEnd = 0;
+};
+
+// Band height for an image of `height` rows: about four bands per thread so that stealing
+// can even out the load, but never fewer than minRows rows (the halo is recomputed per band).
+std::uint32_t RowBandHeight(std::uint32_t height, unsigned threadCount, std::uint32_t minRows);
+
+// Runs fn once per band of bandRows rows (the last may be shorter) on the pool.
+void ParallelRowBands(
+    ThreadPool& pool,
+    std::uint32_t height,
+    std::uint32_t bandRows,
+    std::uint32_t halo,
+    const std::function<void(const RowBand&)>& fn);
+
+// Threads the process may actually use: the CPU affinity mask, further limited by a
+// cgroup CPU quota (cgroup v2 cpu.max or v1 cpu.cfs_quota_us), so that a container
+// granted 2 CPUs on a 32-core host gets 2 threads.
+unsigned DefaultThreadCount();
@@ -134,6 +134,19 @@ def compare_scores(ref_obj, gpu_obj):
     return issues
 
 
+def score_drift(ref_obj, gpu_obj) -> Optional[Tuple[float, float]]:
+    ref_float = _score_float(ref_obj)
+    gpu_float = _score_float(gpu_obj)
+    if ref_float is None or gpu_float is None:
+        return None
+    abs_drift = abs(gpu_float - ref_float)
+    if ref_float != 0.0:
+        rel_drift = abs_drift / abs(ref_float)
+    else:
+        rel_drift = float("inf") if abs_drift else 0.0
+    return (abs_drift, rel_drift)
+
+
 def _resolve_dump_entry(obj: dict, key: str) -> Optional[dict]:
     entry = _get_nested(obj, "debug_dumps", key)
     if entry is None:
@@ -297,6 +310,11 @@ def main():
         action="store_true",
         help="Skip final score comparison and compare only --buffer-key.",
     )
+    parser.add_argument(
+        "--report-drift",
+        action="store_true",
+        help="Also print the absolute/relative score_f64 drift (e.g. for --lab-precision f16 runs).",
+    )
     args = parser.parse_args()
 
     try:
@@ -321,6 +339,17 @@ def main():
     elif args.buffer_only:
         issues.append("--buffer-only requires --buffer-key")
 
+    if args.report_drift:
+        drift = score_drift(ref_obj, gpu_obj)
+        if drift is None:
+            print("[compare] drift: n/a (score_f64 missing)")
+        else:
+            lab_precision = _get_nested(gpu_obj, "result", "lab_precision") or "unknown"
+            print(
+                f"[compare] drift: abs={drift[0]:.3e} rel={drift[1]:.3e} "
+                f"(gpu lab_precision={lab_precision})"
+            )
+
     if issues:
         print("[compare] FAIL")
         for issue in issues: